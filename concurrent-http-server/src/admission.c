@@ -0,0 +1,38 @@
+#include "admission.h"
+
+void admission_init(admission_t *a, int max_depth, int target_ms, int interval_ms) {
+    a->max_depth = max_depth;
+    a->target_ns = (uint64_t)target_ms * 1000000ULL;
+    a->interval_ns = (uint64_t)interval_ms * 1000000ULL;
+    atomic_init(&a->first_above, 0);
+    atomic_init(&a->overloaded, 0);
+}
+
+void admission_observe(admission_t *a, uint64_t delay_ns, uint64_t now_ns) {
+    if (a->target_ns == 0) return;
+
+    // só escreve quando o estado muda: em carga normal a cache line fica partilhada
+    if (delay_ns < a->target_ns) {
+        if (atomic_load_explicit(&a->first_above, memory_order_relaxed) != 0)
+            atomic_store_explicit(&a->first_above, 0, memory_order_relaxed);
+        if (atomic_load_explicit(&a->overloaded, memory_order_relaxed))
+            atomic_store_explicit(&a->overloaded, 0, memory_order_relaxed);
+        return;
+    }
+
+    uint64_t first = atomic_load_explicit(&a->first_above, memory_order_relaxed);
+    if (first == 0) {
+        atomic_compare_exchange_strong_explicit(&a->first_above, &first, now_ns,
+                                                memory_order_relaxed, memory_order_relaxed);
+    } else if (now_ns - first >= a->interval_ns &&
+               !atomic_load_explicit(&a->overloaded, memory_order_relaxed)) {
+        atomic_store_explicit(&a->overloaded, 1, memory_order_relaxed);
+    }
+}
+
+int admission_reject(admission_t *a, int queue_depth) {
+    if (a->max_depth > 0 && queue_depth >= a->max_depth) return 1;
+
+    // fila vazia: admite, para que o próximo atraso medido possa sair da sobrecarga
+    return queue_depth > 0 && atomic_load_explicit(&a->overloaded, memory_order_relaxed);
+}
@@ -0,0 +1,33 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// controlo de admissão ao estilo CoDel: as threads do pool medem quanto tempo
+// cada conexão esperou na fila; se o atraso fica acima do alvo durante um
+// intervalo inteiro o worker está sobrecarregado e o event loop responde 503
+typedef struct {
+    int              max_depth;     // OVERLOAD_QUEUE_DEPTH (0: sem limite)
+    uint64_t         target_ns;     // OVERLOAD_TARGET_DELAY_MS (0: desativado)
+    uint64_t         interval_ns;   // OVERLOAD_INTERVAL_MS
+    _Atomic uint64_t first_above;   // quando o atraso passou o alvo (0: abaixo)
+    atomic_int       overloaded;
+} admission_t;
+
+void admission_init(admission_t *a, int max_depth, int target_ms, int interval_ms);
+
+// thread do pool: regista o atraso na fila de uma conexão acabada de retirar
+void admission_observe(admission_t *a, uint64_t delay_ns, uint64_t now_ns);
+
+// event loop: 1 se a conexão deve ser rejeitada com 503
+int admission_reject(admission_t *a, int queue_depth);
+
+static inline uint64_t admission_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif
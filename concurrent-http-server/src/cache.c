@@ -1,134 +1,1169 @@
 #define _GNU_SOURCE
 #include "cache.h"
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
 
-static int find_entry(cache_t *cache, const char *path) {
-    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
-        if (cache->entries[i].in_use &&
-            strcmp(cache->entries[i].path, path) == 0) {
-            return i;
+// arena de um shard: páginas de SLAB_PAGE bytes. As entradas pequenas ocupam
+// objetos de uma classe de tamanho, talhados em spans de 1 ou 2 páginas; as
+// maiores do que a maior classe ocupam páginas seguidas. Um span que fica
+// vazio volta às páginas livres e pode servir outra classe.
+
+// corrida de páginas livres: cabeçalho na própria memória livre
+typedef struct {
+    size_t size;   // bytes da corrida
+    size_t next;   // offset da corrida livre seguinte (0: fim da lista)
+} free_run_t;
+
+// descritor de página (só o da primeira página de um span conta, além de head)
+typedef struct {
+    uint32_t head;       // primeira página do span a que pertence
+    int32_t  cls;        // classe, SLAB_LARGE ou SLAB_FREE
+    uint32_t pages;      // páginas do span
+    uint32_t used;       // objetos ocupados
+    uint32_t free_obj;   // offset+1 do primeiro objeto livre no span (0: cheio)
+    uint32_t next;       // lista de spans com objetos livres da classe (página+1)
+    uint32_t prev;
+} slab_page_t;
+
+#define ARENA_ALIGN 16
+#define SLAB_FREE  (-1)
+#define SLAB_LARGE (-2)
+
+// 4 classes por potência de 2, de CACHE_MIN_CHARGE até uma página
+static const uint32_t slab_class_size[SLAB_NUM_CLASSES] = {
+    256, 320, 384, 448, 512, 640, 768, 896, 1024,
+    1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static size_t page_align(size_t n) {
+    return (n + SLAB_PAGE - 1) & ~(size_t)(SLAB_PAGE - 1);
+}
+
+static free_run_t* run_at(cache_t *cache, size_t off) {
+    return (free_run_t*)((char*)cache + off);
+}
+
+static slab_page_t* page_desc(cache_t *cache, cache_shard_t *sh, size_t page) {
+    return (slab_page_t*)((char*)cache + sh->pages_off) + page;
+}
+
+static size_t page_index(cache_shard_t *sh, size_t off) {
+    return (off - sh->arena_off) / SLAB_PAGE;
+}
+
+static size_t page_offset(cache_shard_t *sh, size_t page) {
+    return sh->arena_off + page * SLAB_PAGE;
+}
+
+static int slab_class(size_t size) {
+    for (int c = 0; c < SLAB_NUM_CLASSES; c++) {
+        if (size <= slab_class_size[c]) return c;
+    }
+    return SLAB_LARGE;
+}
+
+// 1 ou 2 páginas, o que desperdiçar menos no fim do span
+static size_t class_pages(int cls) {
+    size_t size = slab_class_size[cls];
+    return (SLAB_PAGE % size) * 2 > (2 * SLAB_PAGE) % size ? 2 : 1;
+}
+
+// bytes que uma entrada de size bytes ocupa de facto (objeto ou páginas inteiras)
+static size_t slab_charge(size_t size) {
+    int cls = slab_class(size);
+    return cls == SLAB_LARGE ? page_align(size) : slab_class_size[cls];
+}
+
+// corridas livres ordenadas por offset: as entradas grandes ficam com a
+// primeira que chega, a partir do início da arena; os spans das classes com a
+// última, a partir do fim, para que os objetos pequenos não partam as
+// corridas de que as grandes precisam; devolve o offset ou 0
+static size_t pages_alloc(cache_t *cache, cache_shard_t *sh, size_t pages, int cls) {
+    size_t need = pages * SLAB_PAGE;
+    size_t prev = 0, found = 0, found_prev = 0;
+
+    for (size_t off = sh->free_head; off != 0; off = run_at(cache, off)->next) {
+        if (run_at(cache, off)->size >= need) {
+            found = off;
+            found_prev = prev;
+            if (cls == SLAB_LARGE) break;
+        }
+        prev = off;
+    }
+    if (!found) return 0;
+
+    free_run_t *r = run_at(cache, found);
+    size_t off;
+    if (r->size == need) {
+        // a corrida inteira sai da lista
+        off = found;
+        if (found_prev) run_at(cache, found_prev)->next = r->next;
+        else sh->free_head = r->next;
+    } else if (cls == SLAB_LARGE) {
+        // o resto continua livre no mesmo lugar da lista
+        off = found;
+        free_run_t *rest = run_at(cache, found + need);
+        rest->size = r->size - need;
+        rest->next = r->next;
+        if (found_prev) run_at(cache, found_prev)->next = found + need;
+        else sh->free_head = found + need;
+    } else {
+        r->size -= need;
+        off = found + r->size;
+    }
+
+    size_t head = page_index(sh, off);
+    for (size_t p = head; p < head + pages; p++) {
+        page_desc(cache, sh, p)->head = (uint32_t)head;
+    }
+    slab_page_t *d = page_desc(cache, sh, head);
+    d->cls = cls;
+    d->pages = (uint32_t)pages;
+    d->used = 0;
+    d->free_obj = 0;
+    d->next = d->prev = 0;
+    return off;
+}
+
+// devolve as páginas do span às corridas livres e junta-as às vizinhas
+static void pages_free(cache_t *cache, cache_shard_t *sh, size_t head) {
+    slab_page_t *d = page_desc(cache, sh, head);
+    size_t off = page_offset(sh, head);
+    free_run_t *r = run_at(cache, off);
+    r->size = d->pages * SLAB_PAGE;
+    d->cls = SLAB_FREE;
+
+    size_t prev = 0, next = sh->free_head;
+    while (next != 0 && next < off) {
+        prev = next;
+        next = run_at(cache, next)->next;
+    }
+
+    r->next = next;
+    if (next != 0 && off + r->size == next) {
+        r->size += run_at(cache, next)->size;
+        r->next = run_at(cache, next)->next;
+    }
+
+    if (prev) {
+        free_run_t *p = run_at(cache, prev);
+        if (prev + p->size == off) {
+            p->size += r->size;
+            p->next = r->next;
+        } else {
+            p->next = off;
+        }
+    } else {
+        sh->free_head = off;
+    }
+}
+
+static void partial_push(cache_t *cache, cache_shard_t *sh, int cls, size_t head) {
+    slab_page_t *d = page_desc(cache, sh, head);
+    d->prev = 0;
+    d->next = sh->partial[cls];
+    if (d->next) page_desc(cache, sh, d->next - 1)->prev = (uint32_t)head + 1;
+    sh->partial[cls] = (uint32_t)head + 1;
+}
+
+static void partial_remove(cache_t *cache, cache_shard_t *sh, int cls, size_t head) {
+    slab_page_t *d = page_desc(cache, sh, head);
+    if (d->prev) page_desc(cache, sh, d->prev - 1)->next = d->next;
+    else sh->partial[cls] = d->next;
+    if (d->next) page_desc(cache, sh, d->next - 1)->prev = d->prev;
+    d->next = d->prev = 0;
+}
+
+// devolve o offset de size bytes na arena ou 0 (sem páginas livres que cheguem)
+static size_t arena_alloc(cache_t *cache, cache_shard_t *sh, size_t size) {
+    int cls = slab_class(size);
+    if (cls == SLAB_LARGE) {
+        return pages_alloc(cache, sh, page_align(size) / SLAB_PAGE, SLAB_LARGE);
+    }
+
+    if (!sh->partial[cls]) {
+        // span novo: todos os objetos ligados na lista de livres do span
+        size_t pages = class_pages(cls);
+        size_t off = pages_alloc(cache, sh, pages, cls);
+        if (!off) return 0;
+
+        size_t obj = slab_class_size[cls];
+        size_t count = pages * SLAB_PAGE / obj;
+        for (size_t i = 0; i < count; i++) {
+            *(uint32_t*)((char*)cache + off + i * obj) = i + 1 < count ? (uint32_t)((i + 1) * obj) + 1 : 0;
+        }
+        size_t head = page_index(sh, off);
+        page_desc(cache, sh, head)->free_obj = 1;
+        partial_push(cache, sh, cls, head);
+    }
+
+    size_t head = sh->partial[cls] - 1;
+    slab_page_t *d = page_desc(cache, sh, head);
+    size_t off = page_offset(sh, head) + d->free_obj - 1;
+    d->free_obj = *(uint32_t*)((char*)cache + off);
+    d->used++;
+    if (!d->free_obj) partial_remove(cache, sh, cls, head);
+    return off;
+}
+
+static void arena_free(cache_t *cache, cache_shard_t *sh, size_t off) {
+    size_t head = page_desc(cache, sh, page_index(sh, off))->head;
+    slab_page_t *d = page_desc(cache, sh, head);
+    if (d->cls == SLAB_LARGE) {
+        pages_free(cache, sh, head);
+        return;
+    }
+
+    int cls = d->cls;
+    int was_full = d->free_obj == 0;
+    *(uint32_t*)((char*)cache + off) = d->free_obj;
+    d->free_obj = (uint32_t)(off - page_offset(sh, head)) + 1;
+    d->used--;
+
+    if (d->used == 0) {
+        if (!was_full) partial_remove(cache, sh, cls, head);
+        pages_free(cache, sh, head);
+    } else if (was_full) {
+        partial_push(cache, sh, cls, head);
+    }
+}
+
+uint64_t cache_hash_path(const char *path) {
+    // FNV-1a 64 bits
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char*)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// chave canónica: "./" inicial, "//" e "/./" colapsados, para que "./www//a.html"
+// e o path que o watcher de inotify monta para o mesmo ficheiro sejam a mesma entrada
+// -1 se não couber em size
+static int normalize_key(const char *path, char *key, size_t size) {
+    size_t n = 0;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' && n > 0 && key[n - 1] == '/') continue;
+        if (*p == '.' && (n == 0 || key[n - 1] == '/') && (p[1] == '/' || p[1] == '\0')) {
+            if (p[1] == '/') p++;
+            continue;
+        }
+        if (n + 1 >= size) return -1;
+        key[n++] = *p;
+    }
+    // "dir/" e "dir" são o mesmo prefixo
+    if (n > 1 && key[n - 1] == '/') n--;
+    key[n] = '\0';
+    return 0;
+}
+
+static cache_entry_t* entry_at(cache_t *cache, size_t off) {
+    return (cache_entry_t*)((char*)cache + off);
+}
+
+// shard pelos bits altos do hash: os baixos escolhem o slot dentro do shard
+static cache_shard_t* shard_of(cache_t *cache, uint64_t hash) {
+    return &cache->shards[(hash >> 32) & (cache->num_shards - 1)];
+}
+
+static cache_slot_t* table(cache_t *cache, cache_shard_t *sh) {
+    return (cache_slot_t*)((char*)cache + sh->table_off);
+}
+
+// pedaço chunk de path (-1: a resposta inteira); cada pedaço tem hash próprio,
+// por isso os de um ficheiro grande ficam espalhados pelos shards; a página de
+// erro fica no mesmo shard e slot de origem que o ficheiro, distinguida pelo chunk
+static uint64_t entry_hash(const char *path, long chunk) {
+    uint64_t h = cache_hash_path(path);
+    if (chunk < 0) return h;
+    h ^= ((uint64_t)chunk + 1) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+// índice do slot com path e chunk, ou -1
+static long find_slot(cache_t *cache, cache_shard_t *sh, const char *path, long chunk, uint64_t hash) {
+    cache_slot_t *slots = table(cache, sh);
+    for (size_t i = hash & sh->table_mask; slots[i].entry_off != 0; i = (i + 1) & sh->table_mask) {
+        cache_entry_t *e = entry_at(cache, slots[i].entry_off);
+        if (slots[i].hash == hash && e->chunk == chunk && strcmp(e->path, path) == 0) {
+            return (long)i;
         }
     }
     return -1;
 }
 
-// remove entrada menos usada (LRU)
-static int evict_victim(cache_t *cache, size_t needed) {
-    if (cache->used_bytes + needed <= cache->max_bytes)
-        return -1;
+// slot de uma entrada indexada
+static size_t slot_of(cache_t *cache, cache_shard_t *sh, cache_entry_t *e) {
+    return (size_t)find_slot(cache, sh, e->path, e->chunk, e->hash);
+}
+
+static void table_insert(cache_t *cache, cache_shard_t *sh, uint64_t hash, size_t entry_off) {
+    cache_slot_t *slots = table(cache, sh);
+    size_t i = hash & sh->table_mask;
+    while (slots[i].entry_off != 0) i = (i + 1) & sh->table_mask;
+    slots[i].hash = hash;
+    slots[i].entry_off = entry_off;
+}
+
+// remoção por backward shift: sem tombstones, as sondagens continuam curtas
+static void table_remove(cache_t *cache, cache_shard_t *sh, size_t i) {
+    cache_slot_t *slots = table(cache, sh);
+    size_t mask = sh->table_mask;
+    size_t j = i;
+
+    for (;;) {
+        j = (j + 1) & mask;
+        if (slots[j].entry_off == 0) break;
+
+        // só recua se o slot de origem de j não estiver entre i (exclusive) e j
+        size_t home = slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].entry_off = 0;
+}
+
+static void list_unlink(cache_t *cache, cache_shard_t *sh, cache_entry_t *e) {
+    cache_list_t *l = &sh->lists[e->segment];
+    if (e->prev) entry_at(cache, e->prev)->next = e->next;
+    else l->head = e->next;
+    if (e->next) entry_at(cache, e->next)->prev = e->prev;
+    else l->tail = e->prev;
+    e->prev = e->next = 0;
+    l->bytes -= e->charge;
+}
+
+static void list_push_front(cache_t *cache, cache_shard_t *sh, cache_entry_t *e, size_t off, int segment) {
+    cache_list_t *l = &sh->lists[segment];
+    e->segment = segment;
+    e->prev = 0;
+    e->next = l->head;
+    if (l->head) entry_at(cache, l->head)->prev = off;
+    l->head = off;
+    if (!l->tail) l->tail = off;
+    l->bytes += e->charge;
+}
 
-    int victim = -1;
-    unsigned long best = (unsigned long)-1;
+// entrada tocada (hit) desde que entrou ou subiu na lista
+static int touched(cache_entry_t *e) {
+    unsigned long used = atomic_load_explicit(&e->last_used, memory_order_relaxed);
+    if (used == e->listed_at) return 0;
+    e->listed_at = used;
+    return 1;
+}
 
-    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
-        if (cache->entries[i].in_use &&
-            cache->entries[i].last_used < best) {
-            best = cache->entries[i].last_used;
-            victim = i;
+static void remove_entry(cache_t *cache, cache_shard_t *sh, size_t slot) {
+    size_t off = table(cache, sh)[slot].entry_off;
+    cache_entry_t *e = entry_at(cache, off);
+
+    table_remove(cache, sh, slot);
+    list_unlink(cache, sh, e);
+    sh->used_bytes -= e->charge;
+    sh->num_entries--;
+
+    // ainda a ser enviada por algum leitor: o último cache_release liberta o bloco
+    if (atomic_fetch_sub_explicit(&e->refs, 1, memory_order_acq_rel) == 1) {
+        arena_free(cache, sh, off);
+    }
+}
+
+// LRU: despeja a entrada menos recente do shard; 0 se despejou, -1 se está vazio
+// os hits só marcam last_used (sob rdlock); as entradas tocadas desde que
+// entraram na lista sobem aqui ao topo, cada uma no máximo uma vez por hit
+// W-TinyLFU: só para arena fragmentada; despeja a cauda da probatória,
+// senão da janela, senão da protegida
+// sem entradas positivas, despeja a negativa mais antiga
+static int evict_victim(cache_t *cache, cache_shard_t *sh) {
+    size_t off;
+    if (cache->policy == CACHE_POLICY_TINYLFU) {
+        off = sh->lists[CACHE_SEG_PROBATION].tail;
+        if (!off) off = sh->lists[CACHE_SEG_WINDOW].tail;
+        if (!off) off = sh->lists[CACHE_SEG_PROTECTED].tail;
+    } else {
+        while ((off = sh->lists[CACHE_SEG_WINDOW].tail) != 0) {
+            cache_entry_t *e = entry_at(cache, off);
+            if (!touched(e)) break;
+            list_unlink(cache, sh, e);
+            list_push_front(cache, sh, e, off, CACHE_SEG_WINDOW);
         }
     }
+    if (!off) off = sh->lists[CACHE_SEG_NEGATIVE].tail;
+    if (!off) return -1;
+
+    cache_entry_t *e = entry_at(cache, off);
+    remove_entry(cache, sh, slot_of(cache, sh, e));
+    return 0;
+}
+
+// --- W-TinyLFU ---
+
+#define SKETCH_DEPTH 4
+#define SKETCH_MAX   15     // contadores saturam aqui (4 bits bastam)
+
+static uint64_t mix_hash(uint64_t hash) {
+    // os bits altos escolhem o shard e os baixos o slot: remistura para o sketch
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static atomic_uchar* sketch(cache_t *cache, cache_shard_t *sh) {
+    return (atomic_uchar*)((char*)cache + sh->sketch_off);
+}
+
+static _Atomic uint64_t* doorkeeper(cache_t *cache, cache_shard_t *sh) {
+    return (_Atomic uint64_t*)((char*)cache + sh->door_off);
+}
+
+// double hashing: posição i = h1 + i * h2
+static size_t sketch_index(cache_shard_t *sh, uint64_t h, int i) {
+    return (size_t)(h + (uint64_t)i * ((h >> 32) | 1)) & sh->sketch_mask;
+}
+
+static size_t door_index(cache_shard_t *sh, uint64_t h, int i) {
+    return (size_t)((h >> 16) + (uint64_t)i * ((h >> 40) | 1)) & sh->door_mask;
+}
+
+// regista um acesso (hit ou miss); a primeira vez que uma chave aparece só
+// marca o doorkeeper, para que ficheiros pedidos uma vez não ocupem o sketch
+// corre sob rdlock: contadores atómicos, um incremento concorrente pode perder-se
+static void sketch_record(cache_t *cache, cache_shard_t *sh, uint64_t hash) {
+    uint64_t h = mix_hash(hash);
+    _Atomic uint64_t *door = doorkeeper(cache, sh);
+
+    int seen = 1;
+    for (int i = 0; i < 2; i++) {
+        size_t bit = door_index(sh, h, i);
+        uint64_t mask = 1ULL << (bit & 63);
+        if (!(atomic_fetch_or_explicit(&door[bit >> 6], mask, memory_order_relaxed) & mask))
+            seen = 0;
+    }
+    if (!seen) return;
+
+    atomic_uchar *counters = sketch(cache, sh);
+    for (int i = 0; i < SKETCH_DEPTH; i++) {
+        atomic_uchar *c = &counters[sketch_index(sh, h, i)];
+        unsigned char v = atomic_load_explicit(c, memory_order_relaxed);
+        if (v < SKETCH_MAX) atomic_store_explicit(c, v + 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&sh->sketch_adds, 1, memory_order_relaxed);
+}
+
+// estimativa de acessos recentes: mínimo dos contadores + doorkeeper
+static unsigned frequency(cache_t *cache, cache_shard_t *sh, uint64_t hash) {
+    uint64_t h = mix_hash(hash);
+    _Atomic uint64_t *door = doorkeeper(cache, sh);
+
+    unsigned in_door = 1;
+    for (int i = 0; i < 2; i++) {
+        size_t bit = door_index(sh, h, i);
+        if (!(atomic_load_explicit(&door[bit >> 6], memory_order_relaxed) & (1ULL << (bit & 63))))
+            in_door = 0;
+    }
+
+    atomic_uchar *counters = sketch(cache, sh);
+    unsigned freq = SKETCH_MAX;
+    for (int i = 0; i < SKETCH_DEPTH; i++) {
+        unsigned v = atomic_load_explicit(&counters[sketch_index(sh, h, i)], memory_order_relaxed);
+        if (v < freq) freq = v;
+    }
+    return freq + in_door;
+}
+
+// envelhecimento: a cada sample_size acessos divide os contadores por 2 e limpa
+// o doorkeeper, para que a popularidade antiga não prenda entradas para sempre
+static void sketch_age(cache_t *cache, cache_shard_t *sh) {
+    if (atomic_load_explicit(&sh->sketch_adds, memory_order_relaxed) < sh->sample_size) return;
 
-    if (victim >= 0) {
-        cache_entry_t *e = &cache->entries[victim];
-        cache->used_bytes -= e->size;
-        free(e->data);
-        e->data = NULL;
-        e->size = 0;
-        e->in_use = 0;
+    atomic_uchar *counters = sketch(cache, sh);
+    for (size_t i = 0; i <= sh->sketch_mask; i++) {
+        unsigned char v = atomic_load_explicit(&counters[i], memory_order_relaxed);
+        atomic_store_explicit(&counters[i], v >> 1, memory_order_relaxed);
     }
+    _Atomic uint64_t *door = doorkeeper(cache, sh);
+    for (size_t i = 0; i <= sh->door_mask >> 6; i++) {
+        atomic_store_explicit(&door[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&sh->sketch_adds, 0, memory_order_relaxed);
+}
 
-    return victim;
+// protegida acima do orçamento: as caudas não tocadas descem para a probatória
+static void demote_protected(cache_t *cache, cache_shard_t *sh) {
+    cache_list_t *prot = &sh->lists[CACHE_SEG_PROTECTED];
+    while (prot->bytes > sh->protected_max && prot->tail) {
+        size_t off = prot->tail;
+        cache_entry_t *e = entry_at(cache, off);
+        int segment = touched(e) ? CACHE_SEG_PROTECTED : CACHE_SEG_PROBATION;
+        list_unlink(cache, sh, e);
+        list_push_front(cache, sh, e, off, segment);
+    }
+}
+
+// tocada desde que entrou na lista, sem consumir o hit
+static int peek_touched(cache_entry_t *e) {
+    return atomic_load_explicit(&e->last_used, memory_order_relaxed) != e->listed_at;
 }
 
-void cache_init(cache_t *cache, size_t max_bytes) {
-    memset(cache, 0, sizeof(*cache));
+// percorre as vítimas do segmento principal pela ordem de despejo: probatória
+// não tocada da cauda para a cabeça, depois a protegida, depois as tocadas da
+// probatória; com promote, as tocadas sobem à protegida à passagem e aparecem
+// aí pela mesma ordem
+typedef struct {
+    int    pass;
+    int    promote;
+    size_t next;
+} victim_walk_t;
+
+static size_t next_victim(cache_t *cache, cache_shard_t *sh, victim_walk_t *w) {
+    while (w->pass < 3) {
+        size_t off = w->next;
+        if (!off) {
+            w->pass++;
+            w->next = w->pass == 1 ? sh->lists[CACHE_SEG_PROTECTED].tail
+                    : w->pass == 2 ? sh->lists[CACHE_SEG_PROBATION].tail : 0;
+            continue;
+        }
+
+        cache_entry_t *e = entry_at(cache, off);
+        w->next = e->prev;
+        int hot = peek_touched(e);
+        if (w->pass == 1 || (w->pass == 0) != hot) return off;
+        if (w->pass == 0 && w->promote) {
+            touched(e);
+            list_unlink(cache, sh, e);
+            list_push_front(cache, sh, e, off, CACHE_SEG_PROTECTED);
+        }
+    }
+    return 0;
+}
+
+// despeja do segmento principal, pela ordem de next_victim, até caber charge
+// devolve 0 se charge não cabe nem com o segmento vazio
+static int evict_main(cache_t *cache, cache_shard_t *sh, size_t charge) {
+    size_t main_max = sh->max_bytes - sh->window_max;
+    if (charge > main_max) return 0;
+
+    victim_walk_t walk = { 0, 1, sh->lists[CACHE_SEG_PROBATION].tail };
+    size_t off;
+    while (sh->lists[CACHE_SEG_PROBATION].bytes + sh->lists[CACHE_SEG_PROTECTED].bytes + charge > main_max &&
+           (off = next_victim(cache, sh, &walk)) != 0) {
+        remove_entry(cache, sh, slot_of(cache, sh, entry_at(cache, off)));
+    }
+    demote_protected(cache, sh);
+    return 1;
+}
+
+// o candidato (cauda da janela, ou entrada nova maior do que a janela) só entra
+// no segmento principal se for mais frequente do que cada vítima que desaloja;
+// compara primeiro com todas sem mexer nas listas e só depois as despeja
+// devolve 1 se há espaço para ele, 0 se foi rejeitado
+static int admit_main(cache_t *cache, cache_shard_t *sh, uint64_t hash, size_t charge) {
+    size_t main_max = sh->max_bytes - sh->window_max;
+    size_t main_bytes = sh->lists[CACHE_SEG_PROBATION].bytes + sh->lists[CACHE_SEG_PROTECTED].bytes;
+    if (main_bytes + charge <= main_max) return 1;
+    if (charge > main_max) return 0;
+
+    unsigned freq = frequency(cache, sh, hash);
+    size_t excess = main_bytes + charge - main_max, freed = 0;
+    victim_walk_t walk = { 0, 0, sh->lists[CACHE_SEG_PROBATION].tail };
+    while (freed < excess) {
+        size_t off = next_victim(cache, sh, &walk);
+        if (!off) return 0;
+
+        cache_entry_t *victim = entry_at(cache, off);
+        if (freq <= frequency(cache, sh, victim->hash)) return 0;
+        freed += victim->charge;
+    }
+
+    // ganhou a todas: despeja as mesmas, pela mesma ordem
+    return evict_main(cache, sh, charge);
+}
+
+// abre espaço na janela para charge bytes: as caudas não tocadas passam a
+// candidatas ao segmento principal (probatória) ou saem da cache
+static void shrink_window(cache_t *cache, cache_shard_t *sh, size_t charge) {
+    cache_list_t *window = &sh->lists[CACHE_SEG_WINDOW];
+    while (window->bytes + charge > sh->window_max && window->tail) {
+        size_t off = window->tail;
+        cache_entry_t *e = entry_at(cache, off);
+        if (touched(e)) {
+            list_unlink(cache, sh, e);
+            list_push_front(cache, sh, e, off, CACHE_SEG_WINDOW);
+            continue;
+        }
+
+        if (admit_main(cache, sh, e->hash, e->charge)) {
+            list_unlink(cache, sh, e);
+            list_push_front(cache, sh, e, off, CACHE_SEG_PROBATION);
+        } else {
+            remove_entry(cache, sh, slot_of(cache, sh, e));
+        }
+    }
+}
+
+// potência de 2 até CACHE_MAX_SHARDS; 0 escolhe a partir do orçamento
+static unsigned pick_shards(size_t max_bytes, unsigned requested) {
+    unsigned n = 1;
+    if (requested == 0) {
+        while (n * 2 <= CACHE_MAX_SHARDS && max_bytes / (n * 2) >= CACHE_MAX_FILE_SIZE) n *= 2;
+    } else {
+        while (n * 2 <= requested && n * 2 <= CACHE_MAX_SHARDS) n *= 2;
+    }
+    return n;
+}
+
+cache_t* cache_create(size_t max_bytes, unsigned num_shards, int policy, int huge_pages) {
+    num_shards = pick_shards(max_bytes, num_shards);
+    size_t shard_bytes = max_bytes / num_shards;
+
+    // por shard: tabela com pelo menos o dobro dos slots das entradas que cabem
+    // no orçamento do shard, sketch com um contador por slot e doorkeeper com
+    // 8 bits por contador (usados só com W-TinyLFU), descritores das páginas
+    // e a arena, alinhada à página
+    size_t max_entries = shard_bytes / CACHE_MIN_CHARGE + 1;
+    size_t table_slots = 16;
+    while (table_slots < max_entries * 2) table_slots <<= 1;
+
+    size_t table_bytes = align_up(table_slots * sizeof(cache_slot_t));
+    size_t sketch_bytes = align_up(table_slots);
+    size_t door_bytes = align_up(table_slots);
+    size_t negative_max = shard_bytes / 16;
+    if (negative_max < 4 * CACHE_MIN_CHARGE) negative_max = 4 * CACHE_MIN_CHARGE;
+    // folga para um span meio cheio por classe: o orçamento continua alcançável
+    size_t arena_size = page_align(shard_bytes + negative_max + SLAB_NUM_CLASSES * 2 * SLAB_PAGE);
+    size_t num_pages = arena_size / SLAB_PAGE;
+    size_t pages_bytes = align_up(num_pages * sizeof(slab_page_t));
+    size_t meta_size = page_align(table_bytes + sketch_bytes + door_bytes + pages_bytes);
+    size_t shard_size = meta_size + arena_size;
+    size_t shards_off = page_align(sizeof(cache_t) + num_shards * sizeof(cache_shard_t));
+    size_t segment_size = shards_off + num_shards * shard_size;
+
+    cache_t *cache = MAP_FAILED;
+    int hugetlb = 0;
+    if (huge_pages) {
+        // huge pages reservadas (vm.nr_hugepages): mapeamento anónimo partilhado,
+        // herdado pelos workers no fork; menos entradas na TLB para a arena
+        size_t huge_size = (segment_size + CACHE_HUGE_PAGE - 1) & ~(size_t)(CACHE_HUGE_PAGE - 1);
+        cache = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (cache != MAP_FAILED) {
+            segment_size = huge_size;
+            hugetlb = 1;
+        } else {
+            fprintf(stderr, "[CACHE] Sem huge pages reservadas (vm.nr_hugepages), "
+                            "a pedir transparent huge pages\n");
+        }
+    }
+
+    if (cache == MAP_FAILED) {
+        shm_unlink(CACHE_SHM_NAME);
+        int shm_fd = shm_open(CACHE_SHM_NAME, O_CREAT | O_RDWR, 0666);
+        if (shm_fd == -1) {
+            perror("shm_open cache");
+            return NULL;
+        }
+
+        if (ftruncate(shm_fd, segment_size) == -1) {
+            perror("ftruncate cache");
+            close(shm_fd);
+            shm_unlink(CACHE_SHM_NAME);
+            return NULL;
+        }
+
+        cache = mmap(NULL, segment_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, shm_fd, 0);
+        close(shm_fd);
+
+        if (cache == MAP_FAILED) {
+            perror("mmap cache");
+            shm_unlink(CACHE_SHM_NAME);
+            return NULL;
+        }
+
+        // só com shmem_enabled=advise|always em /sys/kernel/mm/transparent_hugepage
+        if (huge_pages) madvise(cache, segment_size, MADV_HUGEPAGE);
+    }
+
+    // ftruncate e MAP_ANONYMOUS deixam tudo a zeros (tabelas com todos os slots vazios)
     cache->max_bytes = max_bytes;
-    pthread_rwlock_init(&cache->lock, NULL);
+    cache->hugetlb = hugetlb;
+    cache->segment_size = segment_size;
+    cache->num_shards = num_shards;
+    cache->policy = policy;
+
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    size_t off = shards_off;
+    for (unsigned i = 0; i < num_shards; i++) {
+        cache_shard_t *sh = &cache->shards[i];
+        sh->max_bytes = shard_bytes;
+        sh->table_off = off;
+        sh->table_mask = table_slots - 1;
+        sh->sketch_off = off + table_bytes;
+        sh->sketch_mask = table_slots - 1;
+        sh->door_off = sh->sketch_off + sketch_bytes;
+        sh->door_mask = table_slots * 8 - 1;
+        sh->sample_size = table_slots * 10;
+        sh->pages_off = sh->door_off + door_bytes;
+        sh->num_pages = num_pages;
+        sh->arena_off = off + meta_size;
+        sh->arena_size = arena_size;
+        off += shard_size;
+
+        // janela com 1% do orçamento; do resto, 80% para a protegida
+        sh->window_max = shard_bytes / 100;
+        if (sh->window_max < CACHE_MIN_CHARGE) sh->window_max = CACHE_MIN_CHARGE;
+        sh->protected_max = (shard_bytes - sh->window_max) / 5 * 4;
+        sh->negative_max = negative_max;
+
+        // arena começa como uma única corrida de páginas livres
+        free_run_t *first = run_at(cache, sh->arena_off);
+        first->size = arena_size;
+        first->next = 0;
+        sh->free_head = sh->arena_off;
+        for (size_t p = 0; p < num_pages; p++) {
+            page_desc(cache, sh, p)->cls = SLAB_FREE;
+        }
+
+        pthread_rwlock_init(&sh->lock, &attr);
+        pthread_mutex_init(&sh->load_lock, &mutex_attr);
+        pthread_cond_init(&sh->load_done, &cond_attr);
+    }
+
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+    pthread_condattr_destroy(&cond_attr);
+    return cache;
 }
 
 void cache_destroy(cache_t *cache) {
-    pthread_rwlock_wrlock(&cache->lock);
-    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
-        if (cache->entries[i].in_use) {
-            free(cache->entries[i].data);
-        }
-    }
-    pthread_rwlock_unlock(&cache->lock);
-    pthread_rwlock_destroy(&cache->lock);
-}
-
-int cache_get(cache_t *cache, const char *path, const char **data, size_t *size) {
-    // rdlock permite múltiplos leitores concorrentes
-    pthread_rwlock_rdlock(&cache->lock);
-    
-    int idx = find_entry(cache, path);
-    if (idx < 0) {
-        pthread_rwlock_unlock(&cache->lock);
-        return 0;
-    }
-    
-    cache_entry_t *e = &cache->entries[idx];
-    *data = e->data;
-    *size = e->size;
-       
-    pthread_rwlock_unlock(&cache->lock);
-    return 1;
+    if (!cache) return;
+    for (unsigned i = 0; i < cache->num_shards; i++) {
+        pthread_rwlock_destroy(&cache->shards[i].lock);
+        pthread_mutex_destroy(&cache->shards[i].load_lock);
+        pthread_cond_destroy(&cache->shards[i].load_done);
+    }
+    int hugetlb = cache->hugetlb;
+    munmap(cache, cache->segment_size);
+    if (!hugetlb) shm_unlink(CACHE_SHM_NAME);
 }
 
-void cache_put(cache_t *cache, const char *path, const char *data, size_t size) {
-    if (size > cache->max_bytes) return;
+// entrada positiva fixada (refcount) ou NULL; um pedaço só conta com a mesma tag
+static cache_entry_t* get_entry(cache_t *cache, const char *path, long chunk, uint64_t tag) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(path, key, sizeof(key)) != 0) return NULL;
+    path = key;
 
-    pthread_rwlock_wrlock(&cache->lock);
+    uint64_t hash = entry_hash(path, chunk);
+    cache_shard_t *sh = shard_of(cache, hash);
 
-    int idx = find_entry(cache, path);
-    if (idx >= 0) {
-        cache_entry_t *e = &cache->entries[idx];
-        cache->used_bytes -= e->size;
-        free(e->data);
-        e->in_use = 0;
+    // rdlock só do shard: leitores de shards diferentes não partilham o lock
+    pthread_rwlock_rdlock(&sh->lock);
+
+    // W-TinyLFU conta hits e misses: o miss que antecede o cache_put também pesa
+    if (cache->policy == CACHE_POLICY_TINYLFU) {
+        sketch_record(cache, sh, hash);
     }
 
-    while (cache->used_bytes + size > cache->max_bytes) {
-        if (evict_victim(cache, size) < 0)
-            break;
+    long slot = find_slot(cache, sh, path, chunk, hash);
+    if (slot < 0) {
+        pthread_rwlock_unlock(&sh->lock);
+        return NULL;
     }
 
-    if (cache->used_bytes + size > cache->max_bytes) {
-        pthread_rwlock_unlock(&cache->lock);
-        return;
+    size_t off = table(cache, sh)[slot].entry_off;
+    cache_entry_t *e = entry_at(cache, off);
+    if (e->segment == CACHE_SEG_NEGATIVE || e->tag != tag) {
+        pthread_rwlock_unlock(&sh->lock);
+        return NULL;
     }
 
-    int free_idx = -1;
-    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
-        if (!cache->entries[i].in_use) {
-            free_idx = i;
-            break;
+    unsigned long now = atomic_fetch_add_explicit(&sh->clock, 1, memory_order_relaxed) + 1;
+    atomic_store_explicit(&e->last_used, now, memory_order_relaxed);
+
+    // indexada: a cache tem uma referência, por isso refs >= 1 aqui; o que o
+    // chamador lê da entrada não muda enquanto a tiver fixada
+    atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+
+    pthread_rwlock_unlock(&sh->lock);
+    return e;
+}
+
+static cache_entry_t* get_response(cache_t *cache, const char *path, long chunk,
+                                   prebuilt_response_t *resp) {
+    cache_entry_t *e = get_entry(cache, path, chunk, 0);
+    if (!e) return NULL;
+
+    resp->headers = (const char*)e + e->headers_off;
+    resp->headers_len = e->headers_len;
+    resp->date_off = e->date_off;
+    resp->etag_off = e->etag_off;
+    resp->etag_len = e->etag_len;
+    resp->body = (const char*)e + e->body_off;
+    resp->body_len = e->size;
+    return e;
+}
+
+cache_entry_t* cache_get(cache_t *cache, const char *path, prebuilt_response_t *resp) {
+    return get_response(cache, path, -1, resp);
+}
+
+cache_entry_t* cache_get_error_page(cache_t *cache, const char *path, prebuilt_response_t *resp) {
+    return get_response(cache, path, CACHE_ERROR_PAGE, resp);
+}
+
+cache_entry_t* cache_get_chunk(cache_t *cache, const char *path, size_t index, uint64_t tag,
+                               const char **data, size_t *len) {
+    cache_entry_t *e = get_entry(cache, path, (long)index, tag);
+    if (!e) return NULL;
+
+    *data = (const char*)e + e->body_off;
+    *len = e->size;
+    return e;
+}
+
+void cache_release(cache_t *cache, cache_entry_t *e) {
+    if (atomic_fetch_sub_explicit(&e->refs, 1, memory_order_acq_rel) != 1) return;
+
+    // último leitor de uma entrada já despejada
+    cache_shard_t *sh = shard_of(cache, e->hash);
+    pthread_rwlock_wrlock(&sh->lock);
+    arena_free(cache, sh, (size_t)((char*)e - (char*)cache));
+    pthread_rwlock_unlock(&sh->lock);
+}
+
+// 1 se há pedidos à espera da leitura de hash (cache_load_begin)
+static int load_has_waiters(cache_shard_t *sh, uint64_t hash) {
+    int waiters = 0;
+    pthread_mutex_lock(&sh->load_lock);
+    for (int i = 0; i < CACHE_MAX_LOADS; i++) {
+        if (sh->loads[i].hash == hash && sh->loads[i].waiters > 0) waiters = 1;
+    }
+    pthread_mutex_unlock(&sh->load_lock);
+    return waiters;
+}
+
+static void put_entry(cache_t *cache, const char *path, long chunk, uint64_t tag,
+                      const prebuilt_response_t *resp) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(path, key, sizeof(key)) != 0) return;
+    path = key;
+
+    uint64_t hash = entry_hash(path, chunk);
+    cache_shard_t *sh = shard_of(cache, hash);
+
+    size_t path_len = strlen(path);
+    size_t size = resp->body_len;
+    size_t headers_off = sizeof(cache_entry_t) + path_len + 1;
+    size_t body_off = align_up(headers_off + resp->headers_len);
+    // conta o que a entrada ocupa de facto: cabeçalho, path, headers, corpo e
+    // o resto do objeto da classe (ou da última página)
+    size_t charge = slab_charge(body_off + size);
+    if (charge > sh->max_bytes) return;
+
+    pthread_rwlock_wrlock(&sh->lock);
+
+    // o mesmo pedaço de outra versão do ficheiro também sai
+    long slot = find_slot(cache, sh, path, chunk, hash);
+    if (slot >= 0) {
+        remove_entry(cache, sh, (size_t)slot);
+    }
+
+    int segment = CACHE_SEG_WINDOW;
+    if (cache->policy == CACHE_POLICY_TINYLFU) {
+        sketch_age(cache, sh);
+        if (charge > sh->window_max) {
+            // maior do que a janela: é logo candidata ao segmento principal;
+            // com um miss coalescido à espera entra sempre
+            int admitted = load_has_waiters(sh, hash) ? evict_main(cache, sh, charge)
+                                                      : admit_main(cache, sh, hash, charge);
+            if (!admitted) {
+                pthread_rwlock_unlock(&sh->lock);
+                return;
+            }
+            segment = CACHE_SEG_PROBATION;
+        } else {
+            shrink_window(cache, sh, charge);
+        }
+    } else {
+        // as negativas têm orçamento próprio
+        while (sh->used_bytes - sh->lists[CACHE_SEG_NEGATIVE].bytes + charge > sh->max_bytes) {
+            if (evict_victim(cache, sh) < 0)
+                break;
         }
     }
 
-    if (free_idx < 0) {
-        free_idx = evict_victim(cache, size);
-        if (free_idx < 0) {
-            pthread_rwlock_unlock(&cache->lock);
+    // sem páginas livres para um span novo ou para as páginas seguidas de uma
+    // entrada grande: continua a despejar até haver
+    size_t off;
+    while ((off = arena_alloc(cache, sh, body_off + size)) == 0) {
+        if (evict_victim(cache, sh) < 0) {
+            pthread_rwlock_unlock(&sh->lock);
             return;
         }
     }
 
-    cache_entry_t *e = &cache->entries[free_idx];
-    e->data = malloc(size);
-    if (!e->data) {
-        pthread_rwlock_unlock(&cache->lock);
-        return;
+    cache_entry_t *e = entry_at(cache, off);
+    e->hash = hash;
+    e->chunk = chunk;
+    e->tag = tag;
+    e->size = size;
+    e->charge = charge;
+    e->body_off = body_off;
+    e->headers_off = headers_off;
+    e->headers_len = resp->headers_len;
+    e->date_off = resp->date_off;
+    e->etag_off = resp->etag_off;
+    e->etag_len = resp->etag_len;
+    e->expires_at = 0;
+    memcpy(e->path, path, path_len + 1);
+    memcpy((char*)e + headers_off, resp->headers, resp->headers_len);
+    memcpy((char*)e + body_off, resp->body, size);
+
+    unsigned long now = atomic_fetch_add_explicit(&sh->clock, 1, memory_order_relaxed) + 1;
+    atomic_init(&e->last_used, now);
+    atomic_init(&e->refs, 1);
+    e->listed_at = now;
+
+    table_insert(cache, sh, hash, off);
+    list_push_front(cache, sh, e, off, segment);
+    sh->used_bytes += charge;
+    sh->num_entries++;
+
+    pthread_rwlock_unlock(&sh->lock);
+}
+
+void cache_put(cache_t *cache, const char *path, const prebuilt_response_t *resp) {
+    put_entry(cache, path, -1, 0, resp);
+}
+
+void cache_put_error_page(cache_t *cache, const char *path, const prebuilt_response_t *resp) {
+    put_entry(cache, path, CACHE_ERROR_PAGE, 0, resp);
+}
+
+void cache_put_chunk(cache_t *cache, const char *path, size_t index, uint64_t tag,
+                     const char *data, size_t len) {
+    prebuilt_response_t resp = { "", 0, 0, 0, 0, data, len };
+    put_entry(cache, path, (long)index, tag, &resp);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void cache_put_negative(cache_t *cache, const char *path, int ttl_seconds) {
+    char key[CACHE_MAX_KEY];
+    if (ttl_seconds <= 0 || normalize_key(path, key, sizeof(key)) != 0) return;
+    path = key;
+
+    uint64_t hash = cache_hash_path(path);
+    cache_shard_t *sh = shard_of(cache, hash);
+
+    size_t path_len = strlen(path);
+    size_t body_off = align_up(sizeof(cache_entry_t) + path_len + 1);
+    size_t charge = slab_charge(body_off);
+    if (charge > sh->negative_max) return;
+
+    pthread_rwlock_wrlock(&sh->lock);
+
+    // uma entrada positiva aqui está desatualizada (o ficheiro foi apagado)
+    long slot = find_slot(cache, sh, path, -1, hash);
+    if (slot >= 0) {
+        remove_entry(cache, sh, (size_t)slot);
     }
 
-    memcpy(e->data, data, size);
-    strncpy(e->path, path, sizeof(e->path) - 1);
-    e->size = size;
-    cache->used_bytes += size;
-    cache->counter++;
-    e->last_used = cache->counter;
-    e->in_use = 1;
+    // FIFO: com o TTL igual para todas, a mais antiga é a primeira a expirar
+    cache_list_t *negative = &sh->lists[CACHE_SEG_NEGATIVE];
+    while (negative->bytes + charge > sh->negative_max && negative->tail) {
+        cache_entry_t *old = entry_at(cache, negative->tail);
+        remove_entry(cache, sh, slot_of(cache, sh, old));
+    }
+
+    size_t off;
+    while ((off = arena_alloc(cache, sh, body_off)) == 0) {
+        if (evict_victim(cache, sh) < 0) {
+            pthread_rwlock_unlock(&sh->lock);
+            return;
+        }
+    }
+
+    cache_entry_t *e = entry_at(cache, off);
+    memset(e, 0, sizeof(*e));
+    e->hash = hash;
+    e->chunk = -1;
+    e->charge = charge;
+    e->body_off = body_off;
+    e->headers_off = body_off;
+    e->expires_at = monotonic_ns() + (uint64_t)ttl_seconds * 1000000000ULL;
+    memcpy(e->path, path, path_len + 1);
+    atomic_init(&e->last_used, 0);
+    atomic_init(&e->refs, 1);
+
+    table_insert(cache, sh, hash, off);
+    list_push_front(cache, sh, e, off, CACHE_SEG_NEGATIVE);
+    sh->used_bytes += charge;
+    sh->num_entries++;
+
+    pthread_rwlock_unlock(&sh->lock);
+}
+
+int cache_is_negative(cache_t *cache, const char *path) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(path, key, sizeof(key)) != 0) return 0;
+
+    uint64_t hash = cache_hash_path(key);
+    cache_shard_t *sh = shard_of(cache, hash);
+
+    // expirada: fica até ser substituída ou despejada (rdlock não pode remover)
+    pthread_rwlock_rdlock(&sh->lock);
+    long slot = find_slot(cache, sh, key, -1, hash);
+    int negative = 0;
+    if (slot >= 0) {
+        cache_entry_t *e = entry_at(cache, table(cache, sh)[slot].entry_off);
+        negative = e->segment == CACHE_SEG_NEGATIVE && monotonic_ns() < e->expires_at;
+    }
+    pthread_rwlock_unlock(&sh->lock);
+    return negative;
+}
+
+int cache_load_begin(cache_t *cache, const char *path, long chunk) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(path, key, sizeof(key)) != 0) return CACHE_LOAD_ALONE;
+
+    uint64_t hash = entry_hash(key, chunk);
+    if (hash == 0) return CACHE_LOAD_ALONE;
+    cache_shard_t *sh = shard_of(cache, hash);
+    uint64_t now = monotonic_ns();
+
+    pthread_mutex_lock(&sh->load_lock);
+
+    // um registo com o prazo passado é de uma leitura que morreu (worker
+    // terminado) ou demorou demais: o slot pode ser reutilizado
+    int free_slot = -1;
+    for (int i = 0; i < CACHE_MAX_LOADS; i++) {
+        cache_load_t *l = &sh->loads[i];
+        if (l->hash == hash && now < l->deadline) {
+            // outra leitura em curso: espera que acabe (ou que passe o prazo)
+            uint64_t deadline = l->deadline;
+            struct timespec until = { (time_t)(deadline / 1000000000ULL),
+                                      (long)(deadline % 1000000000ULL) };
+            l->waiters++;
+            while (l->hash == hash && l->deadline == deadline) {
+                if (pthread_cond_timedwait(&sh->load_done, &sh->load_lock, &until) == ETIMEDOUT) break;
+            }
+            if (l->waiters > 0) l->waiters--;
+            pthread_mutex_unlock(&sh->load_lock);
+            return CACHE_LOAD_WAITED;
+        }
+        if (free_slot < 0 && (l->hash == 0 || now >= l->deadline)) free_slot = i;
+    }
+
+    if (free_slot < 0) {
+        pthread_mutex_unlock(&sh->load_lock);
+        return CACHE_LOAD_ALONE;
+    }
+    // um registo morto pode ter deixado esperas por descontar
+    if (sh->loads[free_slot].hash != 0) sh->loads[free_slot].waiters = 0;
+    sh->loads[free_slot].hash = hash;
+    sh->loads[free_slot].deadline = now + (uint64_t)CACHE_LOAD_TIMEOUT_MS * 1000000ULL;
+    pthread_mutex_unlock(&sh->load_lock);
+    return CACHE_LOAD_LEADER;
+}
+
+void cache_load_end(cache_t *cache, const char *path, long chunk) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(path, key, sizeof(key)) != 0) return;
+
+    uint64_t hash = entry_hash(key, chunk);
+    cache_shard_t *sh = shard_of(cache, hash);
 
-    pthread_rwlock_unlock(&cache->lock);
+    pthread_mutex_lock(&sh->load_lock);
+    for (int i = 0; i < CACHE_MAX_LOADS; i++) {
+        if (sh->loads[i].hash == hash) {
+            sh->loads[i].hash = 0;
+            sh->loads[i].deadline = 0;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&sh->load_done);
+    pthread_mutex_unlock(&sh->load_lock);
+}
+
+void cache_invalidate(cache_t *cache, const char *path) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(path, key, sizeof(key)) != 0) return;
+
+    // antes de remover: quem guardar depois da remoção já vê a geração nova
+    atomic_fetch_add_explicit(&cache->generation, 1, memory_order_release);
+
+    uint64_t hash = cache_hash_path(key);
+    cache_shard_t *sh = shard_of(cache, hash);
+
+    pthread_rwlock_wrlock(&sh->lock);
+    long slot = find_slot(cache, sh, key, -1, hash);
+    if (slot >= 0) {
+        remove_entry(cache, sh, (size_t)slot);
+    }
+    slot = find_slot(cache, sh, key, CACHE_ERROR_PAGE, hash);
+    if (slot >= 0) {
+        remove_entry(cache, sh, (size_t)slot);
+    }
+    pthread_rwlock_unlock(&sh->lock);
+}
+
+void cache_invalidate_prefix(cache_t *cache, const char *prefix) {
+    char key[CACHE_MAX_KEY];
+    if (normalize_key(prefix, key, sizeof(key)) != 0) return;
+    size_t len = strlen(key);
+
+    atomic_fetch_add_explicit(&cache->generation, 1, memory_order_release);
+
+    for (unsigned s = 0; s < cache->num_shards; s++) {
+        cache_shard_t *sh = &cache->shards[s];
+        cache_slot_t *slots = table(cache, sh);
+
+        pthread_rwlock_wrlock(&sh->lock);
+        // o backward shift pode trazer outra entrada para o slot i: só avança
+        // quando a entrada em i fica
+        for (size_t i = 0; i <= sh->table_mask; ) {
+            if (slots[i].entry_off != 0) {
+                const char *path = entry_at(cache, slots[i].entry_off)->path;
+                if (strncmp(path, key, len) == 0 &&
+                    (len == 0 || key[len - 1] == '/' || path[len] == '\0' || path[len] == '/')) {
+                    remove_entry(cache, sh, i);
+                    continue;
+                }
+            }
+            i++;
+        }
+        pthread_rwlock_unlock(&sh->lock);
+    }
 }
@@ -2,32 +2,203 @@
 #define CACHE_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include "response.h"
+#include "config.h"
 
-#define CACHE_MAX_ENTRIES 128
+#define CACHE_SHM_NAME "/webserver_cache"
+#define CACHE_MIN_CHARGE 256   // cada entrada conta pelo menos isto no orçamento
+#define CACHE_MAX_FILE_SIZE (1024 * 1024)   // maiores entram na cache aos pedaços
+#define CACHE_CHUNK_SIZE (256 * 1024)       // pedaço de um ficheiro grande
+#define CACHE_MAX_SHARDS 64
+#define CACHE_MAX_KEY 1024     // paths maiores não entram na cache
+#define CACHE_HUGE_PAGE (2 * 1024 * 1024)
+#define CACHE_MAX_LOADS 16        // leituras do disco em curso registadas por shard
+#define CACHE_LOAD_TIMEOUT_MS 1000  // quem espera por uma leitura desiste ao fim disto
+#define CACHE_ERROR_PAGE (-2)     // chunk das páginas de erro: não colidem com o ficheiro
 
+// arena em páginas: entradas até uma página em classes de tamanho (slabs),
+// as maiores em páginas seguidas
+#define SLAB_PAGE        4096
+#define SLAB_NUM_CLASSES 17
+
+// listas de um shard: a política LRU usa só a primeira; W-TinyLFU usa uma
+// janela LRU pequena à frente de um LRU segmentado (probatória + protegida)
+// a última guarda os paths que não existem (404), por ordem de entrada
+#define CACHE_SEG_WINDOW    0
+#define CACHE_SEG_PROBATION 1
+#define CACHE_SEG_PROTECTED 2
+#define CACHE_SEG_NEGATIVE  3
+#define CACHE_NUM_SEGMENTS  4
+
+// tudo no segmento partilhado é referido por offsets (relativos ao início
+// do segmento), não ponteiros: o segmento é partilhado por todos os workers
+
+// slot da tabela de hash (open addressing, linear probing)
+typedef struct {
+    uint64_t hash;
+    size_t   entry_off;        // 0: slot vazio
+} cache_slot_t;
+
+// entrada: cabeçalho, path, headers HTTP pré-serializados e corpo num só objeto da arena
+// ou, num ficheiro grande, um pedaço de CACHE_CHUNK_SIZE bytes do corpo (sem headers)
 typedef struct {
-    char   path[512];
-    char  *data;
-    size_t size;
-    unsigned long last_used;
-    int    in_use;
+    uint64_t hash;
+    long     chunk;            // índice do pedaço; -1: resposta inteira; CACHE_ERROR_PAGE: página de erro
+    uint64_t tag;              // pedaço: versão do ficheiro de que foi lido
+    size_t   prev;             // lista do segmento (0: nenhum); prev é mais recente
+    size_t   next;
+    int      segment;          // CACHE_SEG_*
+    size_t   size;             // bytes do corpo
+    size_t   charge;           // bytes contados no orçamento (objeto da classe ou páginas)
+    size_t   body_off;         // offset do corpo a partir da entrada
+    size_t   headers_off;      // offset dos headers a partir da entrada
+    size_t   headers_len;
+    size_t   date_off;         // slot de Date dentro dos headers
+    size_t   etag_off;         // valor do ETag dentro dos headers
+    size_t   etag_len;         // 0: sem ETag
+    uint64_t expires_at;       // entrada negativa: fim do TTL (CLOCK_MONOTONIC, ns)
+    unsigned long listed_at;   // last_used quando entrou ou subiu na lista
+    _Atomic unsigned long last_used;
+    atomic_int refs;           // 1 da própria cache enquanto indexada + leitores a enviar
+    char     path[];
 } cache_entry_t;
 
 typedef struct {
-    cache_entry_t entries[CACHE_MAX_ENTRIES];
+    size_t head;               // mais recente
+    size_t tail;               // candidato a despejo
+    size_t bytes;              // soma dos charges das entradas da lista
+} cache_list_t;
+
+// leitura do disco em curso para uma entrada (miss coalescido); slot livre com hash 0
+typedef struct {
+    uint64_t hash;
+    uint64_t deadline;         // CLOCK_MONOTONIC, ns: depois disto já não se espera
+    int      waiters;          // pedidos à espera: a cópia guardada entra sem admissão
+} cache_load_t;
+
+// shard: fatia independente da cache, escolhida pelo hash do path, com lock,
+// tabela, arena e listas próprios; alinhado a 64 bytes para que os locks de
+// shards vizinhos não partilhem linha de cache
+typedef struct {
     size_t max_bytes;
     size_t used_bytes;
-    unsigned long counter;
-    pthread_rwlock_t lock;
+    size_t num_entries;
+    _Atomic unsigned long clock;   // marca os acessos (LRU)
+    size_t table_off;
+    size_t table_mask;
+    size_t pages_off;          // descritores das páginas da arena
+    size_t num_pages;
+    size_t arena_off;
+    size_t arena_size;
+    size_t free_head;          // primeira corrida de páginas livres (0: nenhuma)
+    uint32_t partial[SLAB_NUM_CLASSES];  // spans com objetos livres, por classe (página+1)
+    cache_list_t lists[CACHE_NUM_SEGMENTS];
+    // W-TinyLFU: orçamentos dos segmentos e estimador de frequência
+    // (count-min sketch de contadores de 8 bits + doorkeeper em bloom filter)
+    size_t window_max;
+    size_t protected_max;
+    size_t negative_max;       // bytes para entradas negativas, fora de max_bytes
+    size_t sketch_off;
+    size_t sketch_mask;
+    size_t door_off;
+    size_t door_mask;          // em bits
+    size_t sample_size;        // acessos até envelhecer o sketch
+    _Atomic size_t sketch_adds;
+    pthread_rwlock_t lock;     // PTHREAD_PROCESS_SHARED
+    // misses coalescidos: quem lê o ficheiro regista-se e acorda os outros no fim
+    cache_load_t    loads[CACHE_MAX_LOADS];
+    pthread_mutex_t load_lock;     // PTHREAD_PROCESS_SHARED
+    pthread_cond_t  load_done;     // PTHREAD_PROCESS_SHARED, CLOCK_MONOTONIC
+} __attribute__((aligned(64))) cache_shard_t;
+
+// cabeçalho do segmento; seguem-se as tabelas de hash e as arenas dos shards
+typedef struct {
+    size_t   max_bytes;
+    size_t   segment_size;
+    unsigned num_shards;       // potência de 2
+    int      policy;           // CACHE_POLICY_LRU ou CACHE_POLICY_TINYLFU
+    int      hugetlb;          // mapeado em huge pages (sem nome em /dev/shm)
+    _Atomic unsigned long generation;  // sobe a cada invalidação do watcher
+    _Atomic unsigned long disk_reads;  // ficheiros e pedaços lidos do disco num miss
+    cache_shard_t shards[];
 } cache_t;
 
-void cache_init(cache_t *cache, size_t max_bytes);
+// muda sempre que algum ficheiro é invalidado: quem guarda metadados por
+// processo (stat_cache) sabe assim que podem estar desatualizados
+static inline unsigned long cache_generation(cache_t *cache) {
+    return atomic_load_explicit(&cache->generation, memory_order_acquire);
+}
+
+static inline void cache_count_disk_read(cache_t *cache) {
+    atomic_fetch_add_explicit(&cache->disk_reads, 1, memory_order_relaxed);
+}
+
+// FNV-1a 64 bits
+uint64_t cache_hash_path(const char *path);
+
+// cria o segmento partilhado (master, antes do fork: os workers herdam o mapeamento)
+// max_bytes é dividido igualmente pelos shards; num_shards é arredondado a
+// potência de 2 e 0 escolhe o máximo que ainda deixa caber um ficheiro de
+// CACHE_MAX_FILE_SIZE em cada shard; huge_pages tenta huge pages reservadas e,
+// sem elas, pede transparent huge pages
+cache_t* cache_create(size_t max_bytes, unsigned num_shards, int policy, int huge_pages);
 void cache_destroy(cache_t *cache);
 
-// retorna 1 se encontrar, 0 caso contrário
-int cache_get(cache_t *cache, const char *path, const char **data, size_t *size);
+// hit: devolve a entrada fixada (refcount) e a resposta pronta em *resp, válida sem
+// lock até cache_release, mesmo que a entrada seja despejada entretanto; NULL se não existir
+cache_entry_t* cache_get(cache_t *cache, const char *path, prebuilt_response_t *resp);
+void cache_release(cache_t *cache, cache_entry_t *e);
+
+// página de erro (./www/404.html, ...) guardada à parte do próprio ficheiro:
+// um GET /404.html nunca recebe a resposta do erro, nem o contrário
+cache_entry_t* cache_get_error_page(cache_t *cache, const char *path, prebuilt_response_t *resp);
+void cache_put_error_page(cache_t *cache, const char *path, const prebuilt_response_t *resp);
+
+// copia headers e corpo de resp para a cache; com W-TinyLFU a entrada passa
+// pela janela e só fica se ganhar às vítimas em frequência de acesso
+void cache_put(cache_t *cache, const char *path, const prebuilt_response_t *resp);
+
+// pedaço index de um ficheiro grande (bytes index * CACHE_CHUNK_SIZE em diante),
+// fixado como em cache_get; tag identifica a versão do ficheiro (ver
+// stat_entry_t) e um pedaço lido de outra versão conta como miss
+cache_entry_t* cache_get_chunk(cache_t *cache, const char *path, size_t index, uint64_t tag,
+                               const char **data, size_t *len);
+// os pedaços são despejados um a um, por isso só os mais pedidos de um
+// ficheiro ficam em memória
+void cache_put_chunk(cache_t *cache, const char *path, size_t index, uint64_t tag,
+                     const char *data, size_t len);
+
+// cache negativa: path que não existe, respondido com 404 sem tocar no disco
+// durante ttl_seconds (ou até o watcher ver o path ser criado); limitada a uma
+// fração de cada shard, as mais antigas saem primeiro
+void cache_put_negative(cache_t *cache, const char *path, int ttl_seconds);
+// 1 se path está na cache negativa e o TTL não expirou
+int cache_is_negative(cache_t *cache, const char *path);
+
+// miss coalescido (single-flight): antes de ler path do disco (chunk: índice do
+// pedaço, -1 para a resposta inteira). CACHE_LOAD_LEADER: quem chama lê, guarda
+// e chama cache_load_end; CACHE_LOAD_WAITED: outro pedido (de qualquer worker)
+// estava a ler e já acabou ou passou do prazo, tenta a cache outra vez e, se
+// falhar, lê sozinho; CACHE_LOAD_ALONE: sem registo livre, lê sem coalescer
+// com pedidos à espera, o put de quem lê entra sem passar pela admissão do
+// W-TinyLFU, para que a cópia lhes chegue mesmo que seja de um ficheiro frio
+#define CACHE_LOAD_ALONE  (-1)
+#define CACHE_LOAD_WAITED 0
+#define CACHE_LOAD_LEADER 1
+int cache_load_begin(cache_t *cache, const char *path, long chunk);
+// a seguir ao cache_put (ou à falha da leitura): acorda quem espera
+void cache_load_end(cache_t *cache, const char *path, long chunk);
 
-void cache_put(cache_t *cache, const char *path, const char *data, size_t size);
+// ficheiro alterado ou apagado: a entrada sai da cache, e a da página de erro
+// se for uma (os leitores que a têm fixada acabam de a enviar); o pedido
+// seguinte volta a ler o disco
+// os pedaços de um ficheiro grande ficam até serem despejados, mas com a tag
+// antiga já não são servidos
+void cache_invalidate(cache_t *cache, const char *path);
+// todas as entradas em prefix ou abaixo ("" limpa a cache inteira)
+void cache_invalidate_prefix(cache_t *cache, const char *prefix);
 
 #endif
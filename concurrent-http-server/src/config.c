@@ -14,12 +14,59 @@ static void trim(char *str) {
     *(end + 1) = 0;
 }
 
+// WORKER_CPU_AFFINITY: "off", "auto" ou lista "0,2,4,6"
+static int parse_cpu_affinity(const char *value, server_config_t *config) {
+    config->num_affinity_cpus = 0;
+
+    if (strcasecmp(value, "off") == 0) {
+        config->cpu_affinity = CPU_AFFINITY_OFF;
+        return 0;
+    }
+    if (strcasecmp(value, "auto") == 0) {
+        config->cpu_affinity = CPU_AFFINITY_AUTO;
+        return 0;
+    }
+
+    const char *p = value;
+    while (*p) {
+        char *end;
+        long cpu = strtol(p, &end, 10);
+        if (end == p || cpu < 0 || config->num_affinity_cpus >= MAX_AFFINITY_CPUS)
+            return -1;
+        config->cpu_list[config->num_affinity_cpus++] = (int)cpu;
+
+        while (isspace((unsigned char)*end)) end++;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        while (isspace((unsigned char)*end)) end++;
+        p = end;
+    }
+
+    if (config->num_affinity_cpus == 0) return -1;
+    config->cpu_affinity = CPU_AFFINITY_LIST;
+    return 0;
+}
+
 int load_config(const char* filename, server_config_t* config) {
     FILE* fp = fopen(filename, "r");
     if (!fp) return -1;
 
     config->num_vhosts = 0;
     config->default_vhost[0] = '\0';
+    config->keepalive_timeout = 5;
+    config->keepalive_max_requests = 50;
+    config->overload_queue_depth = -1;  // por omissão: MAX_QUEUE_SIZE
+    config->overload_target_delay_ms = 50;
+    config->overload_interval_ms = 100;
+    config->retry_after_seconds = 1;
+    config->io_engine = IO_ENGINE_EPOLL;
+    config->cache_policy = CACHE_POLICY_LRU;
+    config->negative_cache_ttl = 5;
+    config->stat_cache_ttl_ms = 1000;
+    config->cache_warmup = CACHE_WARMUP_OFF;
+    config->cache_huge_pages = 0;
+    config->cpu_affinity = CPU_AFFINITY_OFF;
+    config->num_affinity_cpus = 0;
 
     char line[512], key[128], value[256];
 
@@ -54,6 +101,88 @@ int load_config(const char* filename, server_config_t* config) {
             else if (strcmp(key, "TIMEOUT_SECONDS") == 0)
                 config->timeout_seconds = atoi(value);
 
+            else if (strcmp(key, "KEEPALIVE_TIMEOUT_SECONDS") == 0)
+                config->keepalive_timeout = atoi(value);
+
+            else if (strcmp(key, "KEEPALIVE_MAX_REQUESTS") == 0)
+                config->keepalive_max_requests = atoi(value);
+
+            else if (strcmp(key, "OVERLOAD_QUEUE_DEPTH") == 0)
+                config->overload_queue_depth = atoi(value);
+
+            else if (strcmp(key, "OVERLOAD_TARGET_DELAY_MS") == 0)
+                config->overload_target_delay_ms = atoi(value);
+
+            else if (strcmp(key, "OVERLOAD_INTERVAL_MS") == 0)
+                config->overload_interval_ms = atoi(value);
+
+            else if (strcmp(key, "RETRY_AFTER_SECONDS") == 0)
+                config->retry_after_seconds = atoi(value);
+
+            else if (strcmp(key, "NEGATIVE_CACHE_TTL_SECONDS") == 0)
+                config->negative_cache_ttl = atoi(value);
+
+            else if (strcmp(key, "STAT_CACHE_TTL_MS") == 0)
+                config->stat_cache_ttl_ms = atoi(value);
+
+            else if (strcmp(key, "CACHE_POLICY") == 0) {
+                if (strcasecmp(value, "lru") == 0)
+                    config->cache_policy = CACHE_POLICY_LRU;
+                else if (strcasecmp(value, "tinylfu") == 0)
+                    config->cache_policy = CACHE_POLICY_TINYLFU;
+                else {
+                    fprintf(stderr, "ERROR: CACHE_POLICY deve ser 'lru' ou 'tinylfu'\n");
+                    fclose(fp);
+                    return -1;
+                }
+            }
+
+            else if (strcmp(key, "CACHE_HUGE_PAGES") == 0) {
+                if (strcasecmp(value, "on") == 0)
+                    config->cache_huge_pages = 1;
+                else if (strcasecmp(value, "off") == 0)
+                    config->cache_huge_pages = 0;
+                else {
+                    fprintf(stderr, "ERROR: CACHE_HUGE_PAGES deve ser 'on' ou 'off'\n");
+                    fclose(fp);
+                    return -1;
+                }
+            }
+
+            else if (strcmp(key, "CACHE_WARMUP") == 0) {
+                if (strcasecmp(value, "off") == 0)
+                    config->cache_warmup = CACHE_WARMUP_OFF;
+                else if (strcasecmp(value, "roots") == 0)
+                    config->cache_warmup = CACHE_WARMUP_ROOTS;
+                else if (strcasecmp(value, "log") == 0)
+                    config->cache_warmup = CACHE_WARMUP_LOG;
+                else {
+                    fprintf(stderr, "ERROR: CACHE_WARMUP deve ser 'off', 'roots' ou 'log'\n");
+                    fclose(fp);
+                    return -1;
+                }
+            }
+
+            else if (strcmp(key, "IO_ENGINE") == 0) {
+                if (strcasecmp(value, "io_uring") == 0)
+                    config->io_engine = IO_ENGINE_IO_URING;
+                else if (strcasecmp(value, "epoll") == 0)
+                    config->io_engine = IO_ENGINE_EPOLL;
+                else {
+                    fprintf(stderr, "ERROR: IO_ENGINE deve ser 'epoll' ou 'io_uring'\n");
+                    fclose(fp);
+                    return -1;
+                }
+            }
+
+            else if (strcmp(key, "WORKER_CPU_AFFINITY") == 0) {
+                if (parse_cpu_affinity(value, config) != 0) {
+                    fprintf(stderr, "ERROR: WORKER_CPU_AFFINITY deve ser 'off', 'auto' ou lista de CPUs (ex: 0,2,4)\n");
+                    fclose(fp);
+                    return -1;
+                }
+            }
+
             else if (strcmp(key, "DEFAULT_VHOST") == 0)
                 strncpy(config->default_vhost, value, sizeof(config->default_vhost) - 1);
 
@@ -93,10 +222,40 @@ int load_config(const char* filename, server_config_t* config) {
         fprintf(stderr, "ERROR: CACHE_SIZE_MB deve ser >= 0\n");
         return -1;
     }
+    if (config->negative_cache_ttl < 0) {
+        fprintf(stderr, "ERROR: NEGATIVE_CACHE_TTL_SECONDS deve ser >= 0\n");
+        return -1;
+    }
+    if (config->stat_cache_ttl_ms < 0) {
+        fprintf(stderr, "ERROR: STAT_CACHE_TTL_MS deve ser >= 0\n");
+        return -1;
+    }
     if (config->timeout_seconds <= 0) {
         fprintf(stderr, "ERROR: TIMEOUT_SECONDS deve ser > 0\n");
         return -1;
     }
+    if (config->keepalive_timeout <= 0) {
+        fprintf(stderr, "ERROR: KEEPALIVE_TIMEOUT_SECONDS deve ser > 0\n");
+        return -1;
+    }
+    if (config->keepalive_max_requests <= 0) {
+        fprintf(stderr, "ERROR: KEEPALIVE_MAX_REQUESTS deve ser > 0\n");
+        return -1;
+    }
+    if (config->overload_queue_depth < 0)
+        config->overload_queue_depth = config->max_queue_size;
+    if (config->overload_target_delay_ms < 0) {
+        fprintf(stderr, "ERROR: OVERLOAD_TARGET_DELAY_MS deve ser >= 0\n");
+        return -1;
+    }
+    if (config->overload_interval_ms <= 0) {
+        fprintf(stderr, "ERROR: OVERLOAD_INTERVAL_MS deve ser > 0\n");
+        return -1;
+    }
+    if (config->retry_after_seconds <= 0) {
+        fprintf(stderr, "ERROR: RETRY_AFTER_SECONDS deve ser > 0\n");
+        return -1;
+    }
     if (config->document_root[0] == '\0') {
         fprintf(stderr, "ERROR: DOCUMENT_ROOT não configurado\n");
         return -1;
@@ -3,6 +3,26 @@
 
 #define MAX_VHOSTS 10
 
+// motor de I/O do event loop (IO_ENGINE no server.conf)
+#define IO_ENGINE_EPOLL    0
+#define IO_ENGINE_IO_URING 1
+
+#define MAX_AFFINITY_CPUS 64
+
+// afinidade de CPU dos workers (WORKER_CPU_AFFINITY no server.conf)
+#define CPU_AFFINITY_OFF  0   // sem pinning
+#define CPU_AFFINITY_AUTO 1   // worker i → CPU i % número de CPUs
+#define CPU_AFFINITY_LIST 2   // worker i → cpu_list[i % num_affinity_cpus]
+
+// política de substituição da cache (CACHE_POLICY no server.conf)
+#define CACHE_POLICY_LRU     0
+#define CACHE_POLICY_TINYLFU 1   // W-TinyLFU: resiste a varrimentos
+
+// pré-carregamento da cache no arranque (CACHE_WARMUP no server.conf)
+#define CACHE_WARMUP_OFF   0
+#define CACHE_WARMUP_ROOTS 1   // todos os ficheiros das raízes dos vhosts
+#define CACHE_WARMUP_LOG   2   // os paths mais pedidos no LOG_FILE anterior
+
 typedef struct {
     char hostname[256];      // ex: "example.com", "api.example.com"
     char document_root[512]; // ex: "/var/www/example.com", "/var/www/api"
@@ -16,10 +36,25 @@ typedef struct {
     int max_queue_size;
     char log_file[256];
     int cache_size_mb;
-    int timeout_seconds;
+    int cache_policy;            // CACHE_POLICY_LRU ou CACHE_POLICY_TINYLFU
+    int negative_cache_ttl;      // segundos que um 404 fica em cache (0: desativada)
+    int cache_huge_pages;        // arena da cache em huge pages (0/1)
+    int cache_warmup;            // CACHE_WARMUP_OFF / ROOTS / LOG
+    int stat_cache_ttl_ms;       // validade dos metadados e fds abertos por worker (0: sem cache)
+    int timeout_seconds;         // prazo para ler um pedido e para o cliente consumir a resposta
+    int keepalive_timeout;       // segundos idle entre pedidos numa conexão keep-alive
+    int keepalive_max_requests;  // pedidos por conexão antes de a fechar
+    int overload_queue_depth;    // conexões em fila a partir das quais responde 503 (0: sem limite)
+    int overload_target_delay_ms;  // atraso na fila tolerado (0: sem deteção por atraso)
+    int overload_interval_ms;    // tempo acima do alvo até considerar sobrecarga
+    int retry_after_seconds;     // Retry-After das respostas 503
     vhost_t vhosts[MAX_VHOSTS];  // virtual hosts configurados
     int num_vhosts;              // número de vhosts ativos
     char default_vhost[256];     // hostname por omissão
+    int io_engine;               // IO_ENGINE_EPOLL ou IO_ENGINE_IO_URING
+    int cpu_affinity;            // CPU_AFFINITY_OFF / AUTO / LIST
+    int cpu_list[MAX_AFFINITY_CPUS];
+    int num_affinity_cpus;
 } server_config_t;
 
 int load_config(const char* filename, server_config_t* config);
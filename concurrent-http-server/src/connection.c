@@ -0,0 +1,33 @@
+#include "connection.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+conn_t* conn_create(int fd) {
+    conn_t *conn = malloc(sizeof(conn_t));
+    if (!conn) return NULL;
+
+    conn->fd = fd;
+    conn->state = CONN_IDLE;
+    conn->requests_count = 0;
+    timer_node_init(&conn->timer);
+    conn->read_started = 0;
+    conn->queued_at = 0;
+    conn->in_len = 0;
+    conn->in_buf[0] = '\0';
+    out_queue_init(&conn->out, fd);
+    conn->keep_alive = 1;
+    conn->prev = NULL;
+    conn->next = NULL;
+
+    return conn;
+}
+
+void conn_destroy(conn_t *conn) {
+    if (!conn) return;
+    out_queue_reset(&conn->out);
+    if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    free(conn);
+}
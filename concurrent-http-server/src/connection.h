@@ -0,0 +1,36 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "http.h"
+#include "response.h"
+#include "timer_wheel.h"
+
+typedef enum {
+    CONN_IDLE,    // registada no event loop à espera de dados
+    CONN_BUSY,    // entregue a uma thread do pool
+    CONN_WRITING, // resposta por enviar: à espera de espaço no socket
+    CONN_CLOSING  // io_uring: à espera do cancelamento do recv pendente
+} conn_state_t;
+
+// estado de uma conexão keep-alive gerida pelo event loop
+typedef struct conn {
+    int          fd;
+    conn_state_t state;
+    int          requests_count;
+    timer_node_t timer;               // prazo atual (idle, leitura do pedido ou escrita)
+    uint64_t     read_started;        // tick em que chegou o início do pedido atual
+    uint64_t     queued_at;           // ns monotónicos em que entrou na fila do pool
+    size_t       in_len;              // bytes já lidos do pedido atual
+    char         in_buf[BUFFER_SIZE];
+    out_queue_t  out;                 // resposta ainda por enviar
+    int          keep_alive;          // mantém a conexão depois de enviar a resposta
+    struct conn *prev;                // lista de conexões abertas do event loop
+    struct conn *next;
+} conn_t;
+
+conn_t* conn_create(int fd);
+void conn_destroy(conn_t *conn);
+
+#endif
@@ -0,0 +1,512 @@
+#define _GNU_SOURCE
+
+#include "event_loop.h"
+#include "config.h"
+#include "worker.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+#define WRITE_EVENTS  (EPOLLOUT | EPOLLET | EPOLLONESHOT)
+
+// user_data dos SQEs que não pertencem a uma conexão
+#define URING_TAG_ACCEPT 1
+#define URING_TAG_CANCEL 2
+// bit baixo do ponteiro da conexão: poll de escrita em vez de recv
+#define URING_CONN_WRITE 1
+
+static void list_add(event_loop_t *loop, conn_t *conn) {
+    conn->prev = NULL;
+    conn->next = loop->conns;
+    if (loop->conns) loop->conns->prev = conn;
+    loop->conns = conn;
+}
+
+static void list_remove(event_loop_t *loop, conn_t *conn) {
+    if (conn->prev) conn->prev->next = conn->next;
+    else loop->conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    conn->prev = NULL;
+    conn->next = NULL;
+}
+
+// fecha a conexão; chamar com loop->lock adquirido
+static void close_locked(event_loop_t *loop, conn_t *conn) {
+    timer_wheel_del(&conn->timer);
+    list_remove(loop, conn);
+    conn_destroy(conn);
+
+    sem_wait(loop->sems->stats);
+    loop->shared->stats.active_connections--;
+    sem_post(loop->sems->stats);
+}
+
+// ---------- io_uring ----------
+
+// SQE livre; se a SQ estiver cheia submete o que está pendente. chamar com lock
+static struct io_uring_sqe* get_sqe_locked(event_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe) {
+        uring_submit(&loop->ring);
+        sqe = uring_get_sqe(&loop->ring);
+    }
+    return sqe;
+}
+
+static void queue_accept_locked(event_loop_t *loop) {
+    struct io_uring_sqe *sqe = get_sqe_locked(loop);
+    if (!sqe) {
+        fprintf(stderr, "[WORKER PID=%d] io_uring SQ cheia, accept não submetido\n", getpid());
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listen_fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    if (loop->accept_multishot) {
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = URING_TAG_ACCEPT;
+}
+
+// recv para o buffer da conexão; os dados chegam já lidos à thread do pool
+static int queue_recv_locked(event_loop_t *loop, conn_t *conn) {
+    struct io_uring_sqe *sqe = get_sqe_locked(loop);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(conn->in_buf + conn->in_len);
+    sqe->len = (unsigned)(sizeof(conn->in_buf) - 1 - conn->in_len);
+    sqe->user_data = (uint64_t)(uintptr_t)conn;
+    return 0;
+}
+
+// espera até o socket aceitar mais dados da resposta pendente
+static int queue_pollout_locked(event_loop_t *loop, conn_t *conn) {
+    struct io_uring_sqe *sqe = get_sqe_locked(loop);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_CONN_WRITE;
+    return 0;
+}
+
+// cancela o recv ou o poll pendente da conexão
+static void queue_cancel_locked(event_loop_t *loop, conn_t *conn) {
+    struct io_uring_sqe *sqe = get_sqe_locked(loop);
+    if (!sqe) return;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)conn;
+    if (conn->state == CONN_WRITING) sqe->addr |= URING_CONN_WRITE;
+    sqe->user_data = URING_TAG_CANCEL;
+}
+
+static int uring_setup_loop(event_loop_t *loop) {
+    if (uring_init(&loop->ring, URING_SQ_ENTRIES, URING_CQ_ENTRIES) != 0) {
+        return -1;
+    }
+
+    loop->accept_multishot = 1;
+    pthread_mutex_lock(&loop->lock);
+    queue_accept_locked(loop);
+    int ret = uring_submit(&loop->ring);
+    pthread_mutex_unlock(&loop->lock);
+
+    if (ret < 0) {
+        uring_exit(&loop->ring);
+        return -1;
+    }
+    return 0;
+}
+
+// ---------- epoll ----------
+
+static int epoll_setup_loop(event_loop_t *loop) {
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    int flags = fcntl(loop->listen_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(loop->listen_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("fcntl O_NONBLOCK (listen)");
+        close(loop->epoll_fd);
+        return -1;
+    }
+
+    // socket de escuta próprio deste worker (SO_REUSEPORT)
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->listen_fd, &ev) < 0) {
+        perror("epoll_ctl ADD (listen)");
+        close(loop->epoll_fd);
+        return -1;
+    }
+    return 0;
+}
+
+int event_loop_init(event_loop_t *loop, server_config_t *config, int listen_fd,
+                    shared_data_t *shared, semaphores_t *sems,
+                    event_loop_ready_cb on_ready, void *ctx)
+{
+    int engine = config->io_engine;
+    memset(loop, 0, sizeof(*loop));
+    loop->epoll_fd = -1;
+    loop->ring.ring_fd = -1;
+    loop->listen_fd = listen_fd;
+    loop->shared = shared;
+    loop->sems = sems;
+    loop->on_ready = on_ready;
+    loop->ctx = ctx;
+    loop->request_timeout = config->timeout_seconds;
+    loop->keepalive_timeout = config->keepalive_timeout;
+    timer_wheel_init(&loop->timers, timer_wheel_now());
+    pthread_mutex_init(&loop->lock, NULL);
+
+    loop->engine = IO_ENGINE_EPOLL;
+    if (engine == IO_ENGINE_IO_URING) {
+        if (uring_setup_loop(loop) == 0) {
+            loop->engine = IO_ENGINE_IO_URING;
+            return 0;
+        }
+        fprintf(stderr, "[WORKER PID=%d] io_uring indisponível (%s), a usar epoll\n",
+                getpid(), strerror(errno));
+    }
+
+    if (epoll_setup_loop(loop) != 0) {
+        pthread_mutex_destroy(&loop->lock);
+        return -1;
+    }
+    return 0;
+}
+
+void event_loop_destroy(event_loop_t *loop) {
+    // fechar o ring cancela os recv pendentes antes de libertar os buffers
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        uring_exit(&loop->ring);
+    } else {
+        close(loop->epoll_fd);
+    }
+
+    pthread_mutex_lock(&loop->lock);
+    while (loop->conns) {
+        close_locked(loop, loop->conns);
+    }
+    pthread_mutex_unlock(&loop->lock);
+
+    pthread_mutex_destroy(&loop->lock);
+}
+
+// conexão à espera de dados: KEEPALIVE_TIMEOUT_SECONDS entre pedidos, ou TIMEOUT_SECONDS
+// desde o início do pedido (não é prolongado a cada fragmento recebido). chamar com lock
+// devolve -1 se o prazo do pedido já passou (cliente que envia aos poucos)
+static int arm_read_timer_locked(event_loop_t *loop, conn_t *conn) {
+    uint64_t now = timer_wheel_now();
+
+    if (conn->in_len == 0 && conn->requests_count > 0) {
+        timer_wheel_add(&loop->timers, &conn->timer, now + (uint64_t)loop->keepalive_timeout);
+        return 0;
+    }
+
+    if (conn->read_started == 0) conn->read_started = now;
+    uint64_t deadline = conn->read_started + (uint64_t)loop->request_timeout;
+    if (deadline <= now) return -1;
+
+    timer_wheel_add(&loop->timers, &conn->timer, deadline);
+    return 0;
+}
+
+static void register_connection(event_loop_t *loop, int client_fd) {
+    conn_t *conn = conn_create(client_fd);
+    if (!conn) {
+        close(client_fd);
+        return;
+    }
+
+    sem_wait(loop->sems->stats);
+    loop->shared->stats.active_connections++;
+    sem_post(loop->sems->stats);
+
+    pthread_mutex_lock(&loop->lock);
+    list_add(loop, conn);
+    arm_read_timer_locked(loop, conn);
+
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        if (queue_recv_locked(loop, conn) != 0) {
+            close_locked(loop, conn);
+        }
+    } else {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = CLIENT_EVENTS;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            perror("epoll_ctl ADD (client)");
+            close_locked(loop, conn);
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+static void accept_connections(event_loop_t *loop) {
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_fd = accept4(loop->listen_fd, (struct sockaddr*)&client_addr,
+                                &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept4 (event loop)");
+            }
+            return;
+        }
+        register_connection(loop, client_fd);
+    }
+}
+
+// prazo expirado: fecha conexões idle, com pedido incompleto ou que não leem a resposta
+static void on_timer_expired(timer_node_t *node, void *ctx) {
+    event_loop_t *loop = ctx;
+    conn_t *conn = (conn_t*)((char*)node - offsetof(conn_t, timer));
+
+    if (conn->state != CONN_IDLE && conn->state != CONN_WRITING) return;
+
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        // o recv/poll pendente ainda referencia a conexão: liberta no CQE
+        queue_cancel_locked(loop, conn);
+        conn->state = CONN_CLOSING;
+    } else {
+        close_locked(loop, conn);
+    }
+}
+
+// avança o timer wheel; só os prazos do tick atual são visitados
+static void expire_timers(event_loop_t *loop) {
+    uint64_t now = timer_wheel_now();
+    // next_tick só é alterado por esta thread
+    if (now < loop->timers.next_tick) return;
+
+    pthread_mutex_lock(&loop->lock);
+    timer_wheel_advance(&loop->timers, now, on_timer_expired, loop);
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        uring_submit(&loop->ring);
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+static void run_epoll(event_loop_t *loop) {
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+    while (!worker_shutdown) {
+        int n = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            conn_t *conn = events[i].data.ptr;
+            if (!conn) {
+                accept_connections(loop);
+                continue;
+            }
+
+            // EPOLLONESHOT: a conexão fica desativada até event_loop_rearm
+            pthread_mutex_lock(&loop->lock);
+            conn->state = CONN_BUSY;
+            timer_wheel_del(&conn->timer);
+            pthread_mutex_unlock(&loop->lock);
+
+            loop->on_ready(conn, loop->ctx);
+        }
+
+        expire_timers(loop);
+    }
+}
+
+static void handle_accept_cqe(event_loop_t *loop, struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        register_connection(loop, cqe->res);
+    } else if (cqe->res == -EINVAL && loop->accept_multishot) {
+        fprintf(stderr, "[WORKER PID=%d] accept multishot não suportado, a usar accept simples\n", getpid());
+        loop->accept_multishot = 0;
+    } else if (cqe->res == -EINVAL || cqe->res == -EBADF) {
+        // socket de escuta fechado (shutdown): não volta a submeter
+        return;
+    } else if (cqe->res != -EAGAIN && cqe->res != -EINTR && cqe->res != -ECANCELED) {
+        fprintf(stderr, "accept (io_uring): %s\n", strerror(-cqe->res));
+    }
+
+    // multishot termina sem IORING_CQE_F_MORE: volta a submeter
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        pthread_mutex_lock(&loop->lock);
+        queue_accept_locked(loop);
+        uring_submit(&loop->ring);
+        pthread_mutex_unlock(&loop->lock);
+    }
+}
+
+static void handle_recv_cqe(event_loop_t *loop, conn_t *conn, int res) {
+    pthread_mutex_lock(&loop->lock);
+    if (conn->state == CONN_CLOSING || res <= 0) {
+        close_locked(loop, conn);
+        pthread_mutex_unlock(&loop->lock);
+        return;
+    }
+
+    conn->in_len += res;
+    conn->in_buf[conn->in_len] = '\0';
+    conn->state = CONN_BUSY;
+    timer_wheel_del(&conn->timer);
+    pthread_mutex_unlock(&loop->lock);
+
+    loop->on_ready(conn, loop->ctx);
+}
+
+// socket com espaço para escrever: a thread do pool retoma o envio
+static void handle_pollout_cqe(event_loop_t *loop, conn_t *conn, int res) {
+    pthread_mutex_lock(&loop->lock);
+    if (conn->state == CONN_CLOSING || res < 0) {
+        close_locked(loop, conn);
+        pthread_mutex_unlock(&loop->lock);
+        return;
+    }
+
+    conn->state = CONN_BUSY;
+    timer_wheel_del(&conn->timer);
+    pthread_mutex_unlock(&loop->lock);
+
+    loop->on_ready(conn, loop->ctx);
+}
+
+static void run_uring(event_loop_t *loop) {
+    while (!worker_shutdown) {
+        int ret = uring_wait(&loop->ring, 1000);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("io_uring_enter (wait)");
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while (!worker_shutdown && (cqe = uring_peek_cqe(&loop->ring)) != NULL) {
+            uint64_t tag = cqe->user_data;
+            int res = cqe->res;
+
+            if (tag == URING_TAG_ACCEPT) {
+                struct io_uring_cqe copy = *cqe;
+                uring_cqe_seen(&loop->ring);
+                handle_accept_cqe(loop, &copy);
+                continue;
+            }
+            uring_cqe_seen(&loop->ring);
+
+            if (tag == URING_TAG_CANCEL) continue;
+
+            conn_t *conn = (conn_t*)(uintptr_t)(tag & ~(uint64_t)URING_CONN_WRITE);
+            if (tag & URING_CONN_WRITE) {
+                handle_pollout_cqe(loop, conn, res);
+            } else {
+                handle_recv_cqe(loop, conn, res);
+            }
+        }
+
+        // recv das conexões aceites neste lote vão juntos numa só syscall
+        pthread_mutex_lock(&loop->lock);
+        uring_submit(&loop->ring);
+        pthread_mutex_unlock(&loop->lock);
+
+        expire_timers(loop);
+    }
+}
+
+void event_loop_run(event_loop_t *loop) {
+    printf("[WORKER PID=%d] Event loop started (%s), listening on fd=%d\n", getpid(),
+           loop->engine == IO_ENGINE_IO_URING ? "io_uring" : "epoll", loop->listen_fd);
+
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        run_uring(loop);
+    } else {
+        run_epoll(loop);
+    }
+}
+
+void event_loop_rearm(event_loop_t *loop, conn_t *conn) {
+    // o lock impede que o timer feche a conexão antes de voltar ao event loop
+    pthread_mutex_lock(&loop->lock);
+    conn->state = CONN_IDLE;
+    if (arm_read_timer_locked(loop, conn) != 0) {
+        close_locked(loop, conn);
+        pthread_mutex_unlock(&loop->lock);
+        return;
+    }
+
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        if (queue_recv_locked(loop, conn) != 0) {
+            close_locked(loop, conn);
+        } else {
+            uring_submit(&loop->ring);
+        }
+    } else {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = CLIENT_EVENTS;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+            perror("epoll_ctl MOD (client)");
+            close_locked(loop, conn);
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+void event_loop_wait_writable(event_loop_t *loop, conn_t *conn) {
+    pthread_mutex_lock(&loop->lock);
+    conn->state = CONN_WRITING;
+    // TIMEOUT_SECONDS sem progresso na escrita
+    timer_wheel_add(&loop->timers, &conn->timer, timer_wheel_now() + (uint64_t)loop->request_timeout);
+
+    if (loop->engine == IO_ENGINE_IO_URING) {
+        if (queue_pollout_locked(loop, conn) != 0) {
+            close_locked(loop, conn);
+        } else {
+            uring_submit(&loop->ring);
+        }
+    } else {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = WRITE_EVENTS;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+            perror("epoll_ctl MOD (client write)");
+            close_locked(loop, conn);
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+void event_loop_close(event_loop_t *loop, conn_t *conn) {
+    pthread_mutex_lock(&loop->lock);
+    close_locked(loop, conn);
+    pthread_mutex_unlock(&loop->lock);
+}
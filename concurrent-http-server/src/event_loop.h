@@ -0,0 +1,54 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <pthread.h>
+#include "connection.h"
+#include "stats.h"
+#include "config.h"
+#include "uring.h"
+#include "timer_wheel.h"
+
+#define EVENT_LOOP_MAX_EVENTS 64
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+
+// chamado quando uma conexão tem dados prontos (a conexão passa a CONN_BUSY)
+typedef void (*event_loop_ready_cb)(conn_t *conn, void *ctx);
+
+// reactor por processo worker: epoll edge-triggered ou io_uring
+typedef struct {
+    int             engine;      // IO_ENGINE_EPOLL ou IO_ENGINE_IO_URING
+    int             epoll_fd;
+    uring_t         ring;        // io_uring: accept multishot + recv de todas as conexões
+    int             accept_multishot;
+    int             listen_fd;
+    conn_t         *conns;       // conexões abertas (idle e busy)
+    pthread_mutex_t lock;        // protege a lista, o estado das conexões, os timers e a SQ do ring
+    timer_wheel_t   timers;      // prazos das conexões idle e em escrita
+    int             request_timeout;    // TIMEOUT_SECONDS
+    int             keepalive_timeout;  // KEEPALIVE_TIMEOUT_SECONDS
+    shared_data_t  *shared;
+    semaphores_t   *sems;
+    event_loop_ready_cb on_ready;
+    void           *ctx;
+} event_loop_t;
+
+// config->io_engine: IO_ENGINE_IO_URING recorre a epoll se o kernel não o suportar
+int event_loop_init(event_loop_t *loop, server_config_t *config, int listen_fd,
+                    shared_data_t *shared, semaphores_t *sems,
+                    event_loop_ready_cb on_ready, void *ctx);
+void event_loop_destroy(event_loop_t *loop);
+
+// aceita conexões e despacha eventos até worker_shutdown
+void event_loop_run(event_loop_t *loop);
+
+// devolve uma conexão ao event loop depois de processada
+void event_loop_rearm(event_loop_t *loop, conn_t *conn);
+
+// resposta por enviar: volta a entregar a conexão quando o socket tiver espaço
+void event_loop_wait_writable(event_loop_t *loop, conn_t *conn);
+
+// fecha e liberta uma conexão
+void event_loop_close(event_loop_t *loop, conn_t *conn);
+
+#endif
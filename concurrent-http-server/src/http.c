@@ -1,11 +1,13 @@
+#define _GNU_SOURCE
 #include "http.h"
+#include "response.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <sys/socket.h>
-#include <sys/time.h>
-#include <time.h>
+#include <sys/stat.h>
 #include <errno.h>
 
 const char* get_mime_type(const char* path) {
@@ -22,14 +24,29 @@ const char* get_mime_type(const char* path) {
     return "application/octet-stream";
 }
 
-// tenta página de erro customizada, senão usa fallback
-static long send_error_page(int client_fd, const char* status_line, const char* error_file, const char* fallback_body) {
+void build_fullpath(char *buf, size_t size, const char *vroot, const char *path) {
+    if (strcmp(path, "/") == 0) {
+        snprintf(buf, size, "%s/index.html", vroot);
+        return;
+    }
+
+    snprintf(buf, size, "%s%s", vroot, path);
+    
+    size_t len = strlen(buf);
+    if (len > 0 && buf[len - 1] == '/') {
+        if (len + 10 < size) {
+            strncat(buf, "index.html", size - len - 1);
+        }
+    }
+}
+
+// lê a página de erro customizada de ./www (NULL se não existir); liberta com free
+char* load_error_page(const char* error_file, size_t *len) {
     char error_path[512];
     snprintf(error_path, sizeof(error_path), "./www/%s", error_file);
     
     FILE* file = fopen(error_path, "rb");
     char* body = NULL;
-    size_t body_len = 0;
     
     if (file) {
         fseek(file, 0, SEEK_END);
@@ -39,7 +56,7 @@ static long send_error_page(int client_fd, const char* status_line, const char*
             body = malloc(file_size + 1);
             if (body && fread(body, 1, file_size, file) == (size_t)file_size) {
                 body[file_size] = '\0';
-                body_len = file_size;
+                *len = file_size;
             } else {
                 free(body);
                 body = NULL;
@@ -48,35 +65,65 @@ static long send_error_page(int client_fd, const char* status_line, const char*
         fclose(file);
     }
     
+    return body;
+}
+
+// a fila de saída larga a entrada da cache quando o corpo acaba de sair
+static void release_cache_entry(void *cache, void *entry) {
+    cache_release((cache_t*)cache, (cache_entry_t*)entry);
+}
+
+// cache onde ficam as páginas de erro (NULL: lidas do disco a cada erro)
+static cache_t *error_page_cache = NULL;
+
+void http_set_error_page_cache(cache_t *cache) {
+    error_page_cache = cache;
+}
+
+// guarda a página de erro na cache à parte do próprio ficheiro (GET /404.html
+// tem ETag e é outra entrada); o watcher invalida as duas quando é editada
+static void cache_error_page(const char *error_path, const char *body, size_t body_len) {
+    char headers[RESPONSE_HEADERS_SIZE];
+    size_t date_off, etag_off = 0;
+    int headers_len = build_prebuilt_headers(headers, sizeof(headers), "HTTP/1.1 200 OK",
+                                             get_mime_type(error_path), (long)body_len, NULL,
+                                             &date_off, &etag_off);
+    if (headers_len > 0) {
+        prebuilt_response_t resp = { headers, (size_t)headers_len, date_off, 0, 0, body, body_len };
+        cache_put_error_page(error_page_cache, error_path, &resp);
+    }
+}
+
+// tenta página de erro customizada, senão usa fallback
+static long send_error_page(out_queue_t *out, const char* status_line, const char* error_file, const char* fallback_body) {
+    char error_path[512];
+    snprintf(error_path, sizeof(error_path), "./www/%s", error_file);
+
+    // 404 repetidos não voltam a abrir a página: o corpo sai da cache, fixado
+    if (error_page_cache) {
+        prebuilt_response_t cached;
+        cache_entry_t *entry = cache_get_error_page(error_page_cache, error_path, &cached);
+        if (entry) {
+            out_pin_t pin = { release_cache_entry, error_page_cache, entry };
+            return send_response_pinned(out, status_line, "text/html; charset=utf-8",
+                                        NULL, "close", cached.body, cached.body_len, 1, &pin);
+        }
+    }
+
+    size_t body_len = 0;
+    char* body = load_error_page(error_file, &body_len);
+    
+    if (body && error_page_cache) {
+        cache_error_page(error_path, body, body_len);
+    }
+
     if (!body) {
         body = (char*)fallback_body;
         body_len = strlen(fallback_body);
     }
-    
-    char date_header[128];
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    struct tm *gmt = gmtime_r(&now, &tm_buf);
-    if (!gmt) {
-        strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-    } else {
-        strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-    }
-
-    char headers[512];
-    snprintf(headers, sizeof(headers),
-        "%s\r\n"
-        "Content-Type: text/html; charset=utf-8\r\n"
-        "Content-Length: %zu\r\n"
-        "Server: ConcurrentHTTP/1.0\r\n"
-        "Date: %s\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        status_line, body_len, date_header);
-
-    long bytes_sent = 0;
-    bytes_sent += send(client_fd, headers, strlen(headers), 0);
-    bytes_sent += send(client_fd, body, body_len, 0);
+
+    long bytes_sent = send_response(out, status_line, "text/html; charset=utf-8",
+                                    NULL, "close", body, body_len, 1);
     
     if (body != fallback_body) {
         free(body);
@@ -85,7 +132,7 @@ static long send_error_page(int client_fd, const char* status_line, const char*
     return bytes_sent;
 }
 
-long send_error(int client_fd, const char* status_line, const char* body) {
+long send_error(out_queue_t *out, const char* status_line, const char* body) {
     const char* error_file = NULL;
     
     if (strstr(status_line, "403")) {
@@ -99,36 +146,11 @@ long send_error(int client_fd, const char* status_line, const char* body) {
     }
     
     if (error_file) {
-        return send_error_page(client_fd, status_line, error_file, body);
+        return send_error_page(out, status_line, error_file, body);
     }
-    
-    char headers[256];
-    size_t body_len = strlen(body);
-
-    char date_header[128];
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    struct tm *gmt = gmtime_r(&now, &tm_buf);
-    if (!gmt) {
-        strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-    } else {
-        strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-    }
-
-    snprintf(headers, sizeof(headers),
-        "%s\r\n"
-        "Content-Type: text/html\r\n"
-        "Content-Length: %zu\r\n"
-        "Server: ConcurrentHTTP/1.0\r\n"
-        "Date: %s\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        status_line, body_len, date_header);
-
-    long bytes_sent = 0;
-    bytes_sent += send(client_fd, headers, strlen(headers), 0);
-    bytes_sent += send(client_fd, body, body_len, 0);
-    return bytes_sent;
+
+    return send_response(out, status_line, "text/html",
+                         NULL, "close", body, strlen(body), 1);
 }
 
 int parse_http_request(const char *buffer, HttpRequest *req) {
@@ -178,6 +200,33 @@ int parse_http_request(const char *buffer, HttpRequest *req) {
         req->hostname[i] = '\0';
     }
 
+    // Keep-Alive: por omissão em HTTP/1.1, só com "Connection: keep-alive" em HTTP/1.0
+    req->keep_alive = (strcmp(version, "HTTP/1.1") == 0);
+    const char *conn_header = strcasestr(buffer, "\r\nConnection:");
+    if (conn_header) {
+        const char *conn_value = conn_header + 13;
+        while (*conn_value == ' ' || *conn_value == '\t') conn_value++;
+        if (strncasecmp(conn_value, "close", 5) == 0) {
+            req->keep_alive = 0;
+        } else if (strncasecmp(conn_value, "keep-alive", 10) == 0) {
+            req->keep_alive = 1;
+        }
+    }
+
+    // pedido condicional: ETags que o cliente já tem em cache
+    req->if_none_match[0] = '\0';
+    const char *inm_header = strcasestr(buffer, "\r\nIf-None-Match:");
+    if (inm_header) {
+        const char *inm_value = inm_header + 16;
+        while (*inm_value == ' ' || *inm_value == '\t') inm_value++;
+        size_t len = strcspn(inm_value, "\r\n");
+        // truncado não podia corresponder a nada: fica como se não houvesse header
+        if (len < sizeof(req->if_none_match)) {
+            memcpy(req->if_none_match, inm_value, len);
+            req->if_none_match[len] = '\0';
+        }
+    }
+
     // parseia Range Request para downloads parciais
     const char *range_header = strcasestr(buffer, "Range:");
     if (range_header) {
@@ -209,407 +258,402 @@ int parse_http_request(const char *buffer, HttpRequest *req) {
     return 0;
 }
 
-ssize_t read_http_request(int client_fd, char *buffer, size_t size) {
+int etag_matches(const char *if_none_match, const char *etag, size_t etag_len) {
+    if (!if_none_match || !*if_none_match || etag_len == 0) return 0;
+
+    // comparação fraca (RFC 7232): W/ não conta
+    const char *p = if_none_match;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (*p == '*') return 1;
+        if (strncmp(p, "W/", 2) == 0) p += 2;
+
+        size_t len = strcspn(p, ",");
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')) len--;
+        if (len == etag_len && memcmp(p, etag, etag_len) == 0) return 1;
+        p += strcspn(p, ",");
+    }
+    return 0;
+}
+
+int read_http_request(int client_fd, char *buffer, size_t *len, size_t size) {
     if (client_fd < 0) {
         return -1;
     }
-    
-    struct timeval timeout;
-    timeout.tv_sec = 30;
-    timeout.tv_usec = 0;
-    
-    if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        if (errno != EBADF) {
-            perror("setsockopt SO_RCVTIMEO");
-        }
-    }
-    
-    size_t total = 0;
 
-    while (total < size - 1) {
-        ssize_t n = recv(client_fd, buffer + total, size - 1 - total, 0);
+    // com io_uring o event loop pode já ter recebido o pedido completo
+    buffer[*len] = '\0';
+    if (*len >= size - 1 || strstr(buffer, "\r\n\r\n") != NULL)
+        return 1;
+
+    // edge-triggered: lê tudo o que estiver disponível sem bloquear
+    while (*len < size - 1) {
+        ssize_t n = recv(client_fd, buffer + *len, size - 1 - *len, MSG_DONTWAIT);
         if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                fprintf(stderr, "Connection timeout on recv\n");
-            } else {
-                perror("recv");
-            }
-            break;
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno != ECONNRESET) perror("recv");
+            return -1;
         }
         if (n == 0) {
-            break;
+            return -1;
         }
 
-        total += n;
-        buffer[total] = '\0';
+        *len += n;
+        buffer[*len] = '\0';
 
         if (strstr(buffer, "\r\n\r\n") != NULL)
-            break;
+            return 1;
     }
 
-    buffer[total] = '\0';
-    return (ssize_t)total;
-}
+    buffer[*len] = '\0';
 
-long send_file(int client_fd, const char* fullpath, int send_body) {
-    if (access(fullpath, F_OK) != 0) {
-        return send_error(client_fd,
-                          "HTTP/1.1 404 Not Found",
-                          "<h1>404 Not Found</h1>");
-    }
+    // buffer cheio sem fim de headers: processa o que foi lido
+    if (*len >= size - 1)
+        return 1;
 
-    if (access(fullpath, R_OK) != 0) {
-        return send_error(client_fd,
-                          "HTTP/1.1 403 Forbidden",
-                          "<h1>403 Forbidden</h1>");
-    }
+    return 0;
+}
 
-    FILE* file = fopen(fullpath, "rb");
-    if (!file) {
-        return send_error(client_fd,
-                          "HTTP/1.1 500 Internal Server Error",
-                          "<h1>500 Internal Server Error</h1>");
-    }
+// a fila de saída larga a entrada da stat_cache quando o intervalo acaba de sair
+static void release_stat_entry(void *stat_cache, void *entry) {
+    stat_cache_release((stat_cache_t*)stat_cache, (stat_entry_t*)entry);
+}
 
-    if (fseek(file, 0, SEEK_END) != 0) {
-        fclose(file);
-        return send_error(client_fd,
-                          "HTTP/1.1 500 Internal Server Error",
-                          "<h1>500 Internal Server Error</h1>");
-    }
+// header ETag de uma resposta 200 ou 206
+static void format_etag_header(char *buf, size_t size, const char *etag) {
+    snprintf(buf, size, "ETag: %s\r\n", etag);
+}
 
-    long file_size = ftell(file);
-    if (file_size < 0) {
-        fclose(file);
-        return send_error(client_fd,
-                          "HTTP/1.1 500 Internal Server Error",
-                          "<h1>500 Internal Server Error</h1>");
-    }
+long send_file(out_queue_t *out, const char* fullpath, int send_body,
+               stat_cache_t *stat_cache, stat_entry_t *file) {
+    char extra_headers[HTTP_ETAG_SIZE + 16];
+    format_etag_header(extra_headers, sizeof(extra_headers), file->etag);
 
-    fseek(file, 0, SEEK_SET);
+    // fd já aberto pela stat_cache: sem open nem fstat
+    out_pin_t pin = { release_stat_entry, stat_cache, file };
+    return send_file_response(out, "HTTP/1.1 200 OK", get_mime_type(fullpath),
+                              extra_headers, NULL, file->fd, 0, (size_t)file->size, send_body, &pin);
+}
 
-    char *buf = malloc(file_size);
-    if (!buf) {
-        fclose(file);
-        return send_error(client_fd,
-                          "HTTP/1.1 500 Internal Server Error",
-                          "<h1>500 Internal Server Error</h1>");
+// intervalo pedido → [*start, *end] dentro do ficheiro; -1 se não é satisfazível
+static int resolve_range(long file_size, long *start, long *end) {
+    if (*start == -1 && *end > 0) {
+        // suffix range: os últimos *end bytes
+        *start = (file_size > *end) ? (file_size - *end) : 0;
+        *end = file_size - 1;
     }
 
-    size_t read_total = 0;
-    while (read_total < (size_t)file_size) {
-        size_t n = fread(buf + read_total, 1, (size_t)file_size - read_total, file);
-        if (n == 0) break;
-        read_total += n;
+    if (*end == -1) {
+        *end = file_size - 1;
     }
-    fclose(file);
 
-    if (read_total != (size_t)file_size) {
-        free(buf);
-        return send_error(client_fd,
-                          "HTTP/1.1 500 Internal Server Error",
-                          "<h1>500 Internal Server Error</h1>");
-    }
-
-    char date_header[128];
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    struct tm *gmt = gmtime_r(&now, &tm_buf);
-    if (!gmt) {
-        strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-    } else {
-        strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-    }
-
-    const char* mime = get_mime_type(fullpath);
-    long total_sent = 0;
-
-    char headers[512];
-    int hlen = snprintf(headers, sizeof(headers),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %ld\r\n"
-        "Server: ConcurrentHTTP/1.0\r\n"
-        "Date: %s\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        mime, file_size, date_header);
-
-    if (hlen < 0) {
-        free(buf);
-        return 0;
-    }
+    return (*start < 0 || *end >= file_size || *start > *end) ? -1 : 0;
+}
 
-    send(client_fd, headers, hlen, 0);
-    total_sent += hlen;
+static long send_range_not_satisfiable(out_queue_t *out, long file_size) {
+    char error_body[256];
+    char extra_headers[128];
+    int body_len = snprintf(error_body, sizeof(error_body),
+             "<h1>416 Range Not Satisfiable</h1><p>Requested range not satisfiable. File size: %ld bytes</p>",
+             file_size);
+    snprintf(extra_headers, sizeof(extra_headers), "Content-Range: bytes */%ld\r\n", file_size);
 
-    if (send_body) {
-        send(client_fd, buf, (size_t)file_size, 0);
-        total_sent += file_size;
+    return send_response(out, "HTTP/1.1 416 Range Not Satisfiable", "text/html",
+                         extra_headers, "close", error_body, (size_t)body_len, 1);
+}
+
+static void format_content_range(char *buf, size_t size, long start, long end, long file_size,
+                                 const char *etag, size_t etag_len) {
+    int len = snprintf(buf, size,
+        "Content-Range: bytes %ld-%ld/%ld\r\n"
+        "Accept-Ranges: bytes\r\n",
+        start, end, file_size);
+    if (etag_len > 0 && len > 0 && (size_t)len < size) {
+        snprintf(buf + len, size - (size_t)len, "ETag: %.*s\r\n", (int)etag_len, etag);
     }
+}
 
+// ficheiro grande aos pedaços: cada um vem da cache ou é lido do fd da
+// stat_cache e guardado; só o pedaço a enviar está em memória
+typedef struct {
+    cache_t      *cache;
+    stat_cache_t *stat_cache;
+    stat_entry_t *file;        // fixada: fd, tamanho e tag dos pedaços
+    char          path[];
+} chunk_source_t;
+
+static void release_chunk_buffer(void *owner, void *buf) {
+    (void)owner;
     free(buf);
-    return total_sent;
 }
 
-long send_file_range(int client_fd, const char* fullpath, int send_body, long range_start, long range_end) {
-    if (access(fullpath, F_OK) != 0) {
-        return send_error(client_fd, "HTTP/1.1 404 Not Found", "<h1>404 Not Found</h1>");
-    }
-    if (access(fullpath, R_OK) != 0) {
-        return send_error(client_fd, "HTTP/1.1 403 Forbidden", "<h1>403 Forbidden</h1>");
+// hit: o pedaço fica fixado no pedaço a enviar; 0 se não está em cache
+static int cached_chunk(chunk_source_t *src, size_t index, size_t chunk_len, size_t skip,
+                        out_piece_t *piece) {
+    const char *data;
+    size_t len;
+    cache_entry_t *entry = cache_get_chunk(src->cache, src->path, index, src->file->tag, &data, &len);
+    if (!entry) return 0;
+    if (len != chunk_len) {
+        cache_release(src->cache, entry);
+        return 0;
     }
+    piece->data = data + skip;
+    piece->len = chunk_len - skip;
+    piece->pin = (out_pin_t){ release_cache_entry, src->cache, entry };
+    return 1;
+}
 
-    FILE* file = fopen(fullpath, "rb");
-    if (!file) {
-        return send_error(client_fd, "HTTP/1.1 500 Internal Server Error", "<h1>500 Internal Server Error</h1>");
+static int next_chunk(void *ctx, off_t offset, out_piece_t *piece) {
+    chunk_source_t *src = ctx;
+    stat_entry_t *file = src->file;
+    size_t index = (size_t)offset / CACHE_CHUNK_SIZE;
+    size_t chunk_start = index * CACHE_CHUNK_SIZE;
+    size_t chunk_len = (size_t)file->size - chunk_start;
+    if (chunk_len > CACHE_CHUNK_SIZE) chunk_len = CACHE_CHUNK_SIZE;
+    size_t skip = (size_t)offset - chunk_start;
+
+    if (cached_chunk(src, index, chunk_len, skip, piece)) return 0;
+
+    // transferências simultâneas do mesmo ficheiro: cada pedaço é lido uma vez
+    int load = cache_load_begin(src->cache, src->path, (long)index);
+    if (load == CACHE_LOAD_WAITED && cached_chunk(src, index, chunk_len, skip, piece)) return 0;
+
+    // miss: o pedaço inteiro é lido, guardado e enviado desta cópia
+    cache_count_disk_read(src->cache);
+    char *buf = malloc(chunk_len);
+    if (!buf || read_at(file->fd, buf, chunk_len, (off_t)chunk_start) != (ssize_t)chunk_len) {
+        // ficheiro encurtado: o Content-Length já enviado não pode ser cumprido
+        free(buf);
+        if (load == CACHE_LOAD_LEADER) cache_load_end(src->cache, src->path, (long)index);
+        stat_cache_forget(src->stat_cache, file);
+        return -1;
     }
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    if (file_size < 0) {
-        fclose(file);
-        return send_error(client_fd, "HTTP/1.1 500 Internal Server Error", "<h1>500 Internal Server Error</h1>");
+    // alterado desde que foi resolvido: a tag pode já não corresponder ao conteúdo
+    // (outro ficheiro invalidado não conta, senão quem espera lia outra vez)
+    if (cache_generation(src->cache) == file->generation || stat_entry_current(file)) {
+        cache_put_chunk(src->cache, src->path, index, file->tag, buf, chunk_len);
     }
+    if (load == CACHE_LOAD_LEADER) cache_load_end(src->cache, src->path, (long)index);
 
-    if (range_start == -1 && range_end > 0) {
-        range_start = (file_size > range_end) ? (file_size - range_end) : 0;
-        range_end = file_size - 1;
-    }
+    piece->data = buf + skip;
+    piece->len = chunk_len - skip;
+    piece->pin = (out_pin_t){ release_chunk_buffer, NULL, buf };
+    return 0;
+}
 
-    if (range_end == -1) {
-        range_end = file_size - 1;
-    }
+static void release_chunk_source(void *ctx) {
+    chunk_source_t *src = ctx;
+    stat_cache_release(src->stat_cache, src->file);
+    free(src);
+}
 
-    if (range_start < 0 || range_end >= file_size || range_start > range_end) {
-        fclose(file);
-        char error_body[256];
-        snprintf(error_body, sizeof(error_body),
-                 "<h1>416 Range Not Satisfiable</h1><p>Requested range not satisfiable. File size: %ld bytes</p>",
-                 file_size);
-        
-        char date_header[128];
-        time_t now = time(NULL);
-        struct tm tm_buf;
-        struct tm *gmt = gmtime_r(&now, &tm_buf);
-        if (!gmt) {
-            strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-        } else {
-            strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-        }
-        
-        char headers[512];
-        snprintf(headers, sizeof(headers),
-                 "HTTP/1.1 416 Range Not Satisfiable\r\n"
-                 "Content-Type: text/html\r\n"
-                 "Content-Length: %zu\r\n"
-                 "Content-Range: bytes */%ld\r\n"
-                 "Server: ConcurrentHTTP/1.0\r\n"
-                 "Date: %s\r\n"
-                 "Connection: close\r\n"
-                 "\r\n",
-                 strlen(error_body), file_size, date_header);
-        
-        long bytes_sent = 0;
-        bytes_sent += send(client_fd, headers, strlen(headers), 0);
-        bytes_sent += send(client_fd, error_body, strlen(error_body), 0);
-        return bytes_sent;
-    }
+// [offset, offset + length) de um ficheiro grande, pedaço a pedaço à medida
+// que o socket aceita bytes: uma transferência lenta não fixa o ficheiro inteiro
+static long send_file_chunks(out_queue_t *out, const char* fullpath, const char *status_line,
+                             const char *extra_headers, int send_body, cache_t *cache,
+                             stat_cache_t *stat_cache, stat_entry_t *file,
+                             off_t offset, size_t length) {
+    size_t path_len = strlen(fullpath);
+    chunk_source_t *src = malloc(sizeof(chunk_source_t) + path_len + 1);
+    if (!src) {
+        out_pin_t pin = { release_stat_entry, stat_cache, file };
+        return send_file_response(out, status_line, get_mime_type(fullpath), extra_headers, NULL,
+                                  file->fd, offset, length, send_body, &pin);
+    }
+    src->cache = cache;
+    src->stat_cache = stat_cache;
+    src->file = file;
+    memcpy(src->path, fullpath, path_len + 1);
+
+    out_source_t source = { next_chunk, release_chunk_source, src };
+    return send_source_response(out, status_line, get_mime_type(fullpath), extra_headers, NULL,
+                                offset, length, send_body, &source);
+}
 
-    long content_length = range_end - range_start + 1;
-    fseek(file, range_start, SEEK_SET);
-    char *buf = malloc(content_length);
-    if (!buf) {
-        fclose(file);
-        return send_error(client_fd, "HTTP/1.1 500 Internal Server Error", "<h1>500 Internal Server Error</h1>");
+long send_file_range(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                     stat_cache_t *stat_cache, stat_entry_t *file, long range_start, long range_end,
+                     int *status) {
+    long file_size = (long)file->size;
+
+    if (resolve_range(file_size, &range_start, &range_end) != 0) {
+        stat_cache_release(stat_cache, file);
+        *status = 416;
+        return send_range_not_satisfiable(out, file_size);
     }
+    *status = 206;
 
-    size_t read_total = fread(buf, 1, content_length, file);
-    fclose(file);
+    long content_length = range_end - range_start + 1;
+    char extra_headers[256];
+    format_content_range(extra_headers, sizeof(extra_headers), range_start, range_end, file_size,
+                         file->etag, strlen(file->etag));
 
-    if (read_total != (size_t)content_length) {
-        free(buf);
-        return send_error(client_fd, "HTTP/1.1 500 Internal Server Error", "<h1>500 Internal Server Error</h1>");
+    if (cache && (size_t)file_size >= CACHE_MAX_FILE_SIZE) {
+        return send_file_chunks(out, fullpath, "HTTP/1.1 206 Partial Content", extra_headers,
+                                send_body, cache, stat_cache, file,
+                                (off_t)range_start, (size_t)content_length);
     }
 
-    char date_header[128];
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    struct tm *gmt = gmtime_r(&now, &tm_buf);
-    if (!gmt) {
-        strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-    } else {
-        strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-    }
+    // memória constante: o kernel copia o intervalo diretamente do page cache
+    out_pin_t pin = { release_stat_entry, stat_cache, file };
+    return send_file_response(out, "HTTP/1.1 206 Partial Content", get_mime_type(fullpath),
+                              extra_headers, NULL, file->fd,
+                              (off_t)range_start, (size_t)content_length, send_body, &pin);
+}
 
-    const char* mime = get_mime_type(fullpath);
-    long total_sent = 0;
+// o cliente já tem esta versão (If-None-Match): 304 com o ETag guardado
+static long send_cached_not_modified(out_queue_t *out, cache_t *cache, cache_entry_t *entry,
+                                     const prebuilt_response_t *cached, const char *if_none_match,
+                                     int *status) {
+    const char *etag = cached->headers + cached->etag_off;
+    if (!etag_matches(if_none_match, etag, cached->etag_len)) return -1;
+
+    long sent = send_not_modified(out, etag, cached->etag_len);
+    cache_release(cache, entry);
+    *status = 304;
+    return sent;
+}
 
-    char headers[512];
-    int hlen = snprintf(headers, sizeof(headers),
-        "HTTP/1.1 206 Partial Content\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %ld\r\n"
-        "Content-Range: bytes %ld-%ld/%ld\r\n"
-        "Server: ConcurrentHTTP/1.0\r\n"
-        "Date: %s\r\n"
-        "Accept-Ranges: bytes\r\n"
-        "Connection: keep-alive\r\n"
-        "\r\n",
-        mime, content_length, range_start, range_end, file_size, date_header);
-
-    if (hlen < 0) {
-        free(buf);
-        return 0;
-    }
+long send_cached_file(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                      const char *if_none_match, int *status) {
+    prebuilt_response_t cached;
 
-    send(client_fd, headers, hlen, 0);
-    total_sent += hlen;
+    // hit: headers já serializados (só Date e Connection mudam) e corpo numa só
+    // chamada sendmsg, direto da memória partilhada; a entrada fica fixada
+    // enquanto houver bytes do corpo por enviar
+    cache_entry_t *entry = cache_get(cache, fullpath, &cached);
+    if (!entry) return -1;
 
-    if (send_body) {
-        send(client_fd, buf, content_length, 0);
-        total_sent += content_length;
-    }
+    long sent = send_cached_not_modified(out, cache, entry, &cached, if_none_match, status);
+    if (sent >= 0) return sent;
 
-    free(buf);
-    return total_sent;
-}
-
-long send_file_with_cache(int client_fd, const char* fullpath, int send_body, cache_t *cache) {
-    const char *cached_data = NULL;
-    size_t cached_size = 0;
-    long total_sent = 0;
-
-    if (cache && cache_get(cache, fullpath, &cached_data, &cached_size)) {
-        char date_header[128];
-        time_t now = time(NULL);
-        struct tm tm_buf;
-        struct tm *gmt = gmtime_r(&now, &tm_buf);
-        if (!gmt) {
-            strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-        } else {
-            strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-        }
+    *status = 200;
+    out_pin_t pin = { release_cache_entry, cache, entry };
+    return send_prebuilt_response(out, &cached, send_body, &pin);
+}
 
-        const char* mime = get_mime_type(fullpath);
+long send_cached_range(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                       const char *if_none_match, long range_start, long range_end, int *status) {
+    prebuilt_response_t cached;
+    cache_entry_t *entry = cache_get(cache, fullpath, &cached);
+    if (!entry) return -1;
 
-        char headers[512];
-        int hlen = snprintf(headers, sizeof(headers),
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: %s\r\n"
-            "Content-Length: %zu\r\n"
-            "Server: ConcurrentHTTP/1.0\r\n"
-            "Date: %s\r\n"
-            "Connection: close\r\n"
-            "\r\n",
-            mime, cached_size, date_header);
+    // If-None-Match é avaliado antes do Range
+    long sent = send_cached_not_modified(out, cache, entry, &cached, if_none_match, status);
+    if (sent >= 0) return sent;
 
-        if (hlen < 0) return 0;
+    long file_size = (long)cached.body_len;
+    if (resolve_range(file_size, &range_start, &range_end) != 0) {
+        cache_release(cache, entry);
+        *status = 416;
+        return send_range_not_satisfiable(out, file_size);
+    }
+    *status = 206;
 
-        send(client_fd, headers, hlen, 0);
-        total_sent += hlen;
+    char extra_headers[256];
+    format_content_range(extra_headers, sizeof(extra_headers), range_start, range_end, file_size,
+                         cached.headers + cached.etag_off, cached.etag_len);
 
-        if (send_body) {
-            send(client_fd, cached_data, cached_size, 0);
-            total_sent += (long)cached_size;
-        }
+    out_pin_t pin = { release_cache_entry, cache, entry };
+    return send_response_pinned(out, "HTTP/1.1 206 Partial Content", get_mime_type(fullpath),
+                                extra_headers, NULL, cached.body + range_start,
+                                (size_t)(range_end - range_start + 1), send_body, &pin);
+}
 
-        return total_sent;
+ssize_t read_at(int fd, char *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += (size_t)n;
     }
+    return (ssize_t)done;
+}
 
-    long bytes_sent = send_file(client_fd, fullpath, send_body);
-    
-    if (bytes_sent > 0 && cache && access(fullpath, F_OK) == 0 && access(fullpath, R_OK) == 0) {
-        FILE* file = fopen(fullpath, "rb");
-        if (file) {
-            fseek(file, 0, SEEK_END);
-            long file_size = ftell(file);
-            if (file_size > 0 && file_size < 1024*1024) {
-                fseek(file, 0, SEEK_SET);
-                char *file_data = malloc(file_size);
-                if (file_data && fread(file_data, 1, file_size, file) == (size_t)file_size) {
-                    cache_put(cache, fullpath, file_data, file_size);
-                }
-                free(file_data);
-            }
-            fclose(file);
+int cache_put_file(cache_t *cache, const char* fullpath, const char *data, size_t size,
+                   const char *etag) {
+    char headers[RESPONSE_HEADERS_SIZE];
+    size_t date_off, etag_off = 0;
+    int headers_len = build_prebuilt_headers(headers, sizeof(headers), "HTTP/1.1 200 OK",
+                                             get_mime_type(fullpath), (long)size, etag,
+                                             &date_off, &etag_off);
+    if (headers_len <= 0) return -1;
+
+    prebuilt_response_t resp = { headers, (size_t)headers_len, date_off, etag_off,
+                                 etag ? strlen(etag) : 0, data, size };
+    cache_put(cache, fullpath, &resp);
+    return 0;
+}
+
+long send_file_with_cache(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                          stat_cache_t *stat_cache, stat_entry_t *file) {
+    size_t size = (size_t)file->size;
+    if (!cache || size == 0) {
+        return send_file(out, fullpath, send_body, stat_cache, file);
+    }
+    char extra_headers[HTTP_ETAG_SIZE + 16];
+    format_etag_header(extra_headers, sizeof(extra_headers), file->etag);
+    if (size >= CACHE_MAX_FILE_SIZE) {
+        return send_file_chunks(out, fullpath, "HTTP/1.1 200 OK", extra_headers, send_body,
+                                cache, stat_cache, file, 0, size);
+    }
+
+    // vários misses ao mesmo ficheiro (ex: logo depois de uma invalidação): só
+    // o primeiro lê o disco, os outros esperam e servem a cópia que ele guardou
+    int load = cache_load_begin(cache, fullpath, -1);
+    if (load == CACHE_LOAD_WAITED) {
+        int status;
+        long sent = send_cached_file(out, fullpath, send_body, cache, NULL, &status);
+        if (sent >= 0) {
+            stat_cache_release(stat_cache, file);
+            return sent;
         }
     }
-    
-    return bytes_sent;
-}
 
-long send_json_response(int client_fd, const char* json_body, int send_body) {
-    char date_header[128];
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    struct tm *gmt = gmtime_r(&now, &tm_buf);
-    if (!gmt) {
-        strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-    } else {
-        strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
+    // miss: o ficheiro é lido uma só vez, do fd já aberto, e a mesma cópia
+    // serve a resposta e a cache
+    cache_count_disk_read(cache);
+    char *file_data = malloc(size);
+    if (!file_data || read_at(file->fd, file_data, size, 0) != (ssize_t)size) {
+        // mudou de tamanho desde o fstat: não guarda e o próximo pedido reabre
+        free(file_data);
+        if (load == CACHE_LOAD_LEADER) cache_load_end(cache, fullpath, -1);
+        stat_cache_forget(stat_cache, file);
+        return send_file(out, fullpath, send_body, stat_cache, file);
     }
 
-    size_t body_len = strlen(json_body);
-    
-    char headers[512];
-    int hlen = snprintf(headers, sizeof(headers),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: application/json; charset=utf-8\r\n"
-        "Content-Length: %zu\r\n"
-        "Server: ConcurrentHTTP/1.0\r\n"
-        "Date: %s\r\n"
-        "Connection: keep-alive\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "\r\n",
-        body_len, date_header);
-
-    if (hlen < 0) return 0;
-
-    long total_sent = 0;
-    total_sent += send(client_fd, headers, hlen, 0);
-    
-    if (send_body) {
-        total_sent += send(client_fd, json_body, body_len, 0);
+    cache_put_file(cache, fullpath, file_data, size, file->etag);
+
+    // alterado enquanto era lido: a invalidação do watcher pode ter chegado
+    // antes do put e a cópia guardada já estar velha; se a geração subiu por
+    // causa de outro ficheiro, a cópia fica para quem espera por ela
+    if (cache_generation(cache) != file->generation && !stat_entry_current(file)) {
+        cache_invalidate(cache, fullpath);
     }
-    
-    return total_sent;
+    if (load == CACHE_LOAD_LEADER) cache_load_end(cache, fullpath, -1);
+
+    long bytes_sent = send_response(out, "HTTP/1.1 200 OK", get_mime_type(fullpath),
+                                    extra_headers, NULL, file_data, size, send_body);
+    free(file_data);
+    stat_cache_release(stat_cache, file);
+    return bytes_sent;
 }
 
-long send_html_response(int client_fd, const char* html_body, int send_body) {
-    char date_header[128];
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    struct tm *gmt = gmtime_r(&now, &tm_buf);
-    if (!gmt) {
-        strncpy(date_header, "Thu, 01 Jan 1970 00:00:00 GMT", sizeof(date_header));
-    } else {
-        strftime(date_header, sizeof(date_header), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-    }
+long send_json_response(out_queue_t *out, const char* json_body, int send_body) {
+    return send_response(out, "HTTP/1.1 200 OK", "application/json; charset=utf-8",
+                         "Access-Control-Allow-Origin: *\r\n", NULL,
+                         json_body, strlen(json_body), send_body);
+}
 
-    size_t body_len = strlen(html_body);
-    
-    char headers[512];
-    int hlen = snprintf(headers, sizeof(headers),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/html; charset=utf-8\r\n"
-        "Content-Length: %zu\r\n"
-        "Server: ConcurrentHTTP/1.0\r\n"
-        "Date: %s\r\n"
-        "Connection: keep-alive\r\n"
-        "\r\n",
-        body_len, date_header);
-
-    if (hlen < 0) return 0;
-
-    long total_sent = 0;
-    total_sent += send(client_fd, headers, hlen, 0);
-    
-    if (send_body) {
-        total_sent += send(client_fd, html_body, body_len, 0);
-    }
-    
-    return total_sent;
+long send_html_response(out_queue_t *out, const char* html_body, int send_body) {
+    return send_response(out, "HTTP/1.1 200 OK", "text/html; charset=utf-8",
+                         NULL, NULL, html_body, strlen(html_body), send_body);
 }
 
 void generate_dashboard_html(char *buffer, size_t buffer_size) {
@@ -743,8 +787,10 @@ void generate_dashboard_html(char *buffer, size_t buffer_size) {
         "            fetch('/stats')\n"
         "                .then(r => r.json())\n"
         "                .then(data => {\n"
-        "                    const totalStatus = data.requests_by_status['200'] + data.requests_by_status['400'] + \n"
+        "                    const totalStatus = data.requests_by_status['200'] + data.requests_by_status['304'] + \n"
+        "                                      data.requests_by_status['400'] + \n"
         "                                      data.requests_by_status['403'] + data.requests_by_status['404'] + \n"
+        "                                      data.requests_by_status['416'] + \n"
         "                                      data.requests_by_status['500'] + data.requests_by_status['501'] + \n"
         "                                      data.requests_by_status['503'];\n"
         "                    document.getElementById('stats-container').innerHTML = `\n"
@@ -782,9 +828,11 @@ void generate_dashboard_html(char *buffer, size_t buffer_size) {
         "                                </thead>\n"
         "                                <tbody>\n"
         "                                    <tr><td>200 OK</td><td>${data.requests_by_status['200']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['200']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
+        "                                    <tr><td>304 Not Modified</td><td>${data.requests_by_status['304']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['304']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
         "                                    <tr><td>400 Bad Request</td><td>${data.requests_by_status['400']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['400']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
         "                                    <tr><td>403 Forbidden</td><td>${data.requests_by_status['403']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['403']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
         "                                    <tr><td>404 Not Found</td><td>${data.requests_by_status['404']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['404']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
+        "                                    <tr><td>416 Range Not Satisfiable</td><td>${data.requests_by_status['416']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['416']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
         "                                    <tr><td>500 Internal Error</td><td>${data.requests_by_status['500']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['500']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
         "                                    <tr><td>501 Not Implemented</td><td>${data.requests_by_status['501']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['501']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
         "                                    <tr><td>503 Service Unavailable</td><td>${data.requests_by_status['503']}</td><td>${totalStatus > 0 ? ((data.requests_by_status['503']/totalStatus)*100).toFixed(1) : 0}%%</td></tr>\n"
@@ -4,8 +4,10 @@
 #include <sys/types.h>
 #include <stddef.h>
 #include "cache.h"
+#include "stat_cache.h"
+#include "response.h"
 
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE 4096  // buffer de entrada por conexão (vários pedidos em pipeline)
 
 typedef struct {
     char method[16];
@@ -15,17 +17,51 @@ typedef struct {
     long range_end;    // -1 se não há range ou open-ended
     int has_range;     // 0 ou 1
     char hostname[256]; // extraído do header Host (para virtual hosts)
+    int keep_alive;     // HTTP/1.1 por omissão; header Connection sobrepõe
+    char if_none_match[256]; // ETags do cliente ("" se não há header)
 } HttpRequest;
 
 const char* get_mime_type(const char* path);
-long send_error(int client_fd, const char* status_line, const char* body);
+// path do pedido → ficheiro dentro de vroot ("/" e diretórios → index.html)
+void build_fullpath(char *buf, size_t size, const char *vroot, const char *path);
+long send_error(out_queue_t *out, const char* status_line, const char* body);
+char* load_error_page(const char* error_file, size_t *len);
+// páginas de erro passam a ser servidas da cache (chamar antes de servir pedidos)
+void http_set_error_page_cache(cache_t *cache);
 int parse_http_request(const char *buffer, HttpRequest *req);
-ssize_t read_http_request(int client_fd, char *buffer, size_t size);
-long send_file(int client_fd, const char* fullpath, int send_body);
-long send_file_with_cache(int client_fd, const char* fullpath, int send_body, cache_t *cache);
-long send_file_range(int client_fd, const char* fullpath, int send_body, long range_start, long range_end);
-long send_json_response(int client_fd, const char* json_body, int send_body);
-long send_html_response(int client_fd, const char* html_body, int send_body);
+// 1 se algum dos ETags de If-None-Match (lista, "*" ou W/"...") é etag
+int etag_matches(const char *if_none_match, const char *etag, size_t etag_len);
+// lê dados disponíveis para buffer (len = bytes já acumulados)
+// retorna 1 se há um pedido completo, 0 se faltam dados, -1 se a conexão fechou
+int read_http_request(int client_fd, char *buffer, size_t *len, size_t size);
+// file: resolvido pela stat_cache (status 200) e fixado; a resposta fica com a posse
+long send_file(out_queue_t *out, const char* fullpath, int send_body,
+               stat_cache_t *stat_cache, stat_entry_t *file);
+// com cache, os ficheiros a partir de CACHE_MAX_FILE_SIZE saem dos pedaços em cache
+// *status: 206, ou 416 se o Range não cabe no ficheiro
+long send_file_range(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                     stat_cache_t *stat_cache, stat_entry_t *file, long range_start, long range_end,
+                     int *status);
+// hit na cache de conteúdo, sem syscalls sobre o ficheiro; -1 se não está em cache
+// if_none_match (pode ser NULL) igual ao ETag guardado: 304 sem corpo;
+// *status recebe o código enviado
+long send_cached_file(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                      const char *if_none_match, int *status);
+// Range servido da resposta inteira em cache; -1 se não está em cache
+long send_cached_range(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                       const char *if_none_match, long range_start, long range_end, int *status);
+// pread a partir de offset até len bytes ou EOF; devolve os bytes lidos (-1 em erro)
+ssize_t read_at(int fd, char *buf, size_t len, off_t offset);
+// guarda na cache a resposta 200 de fullpath com o corpo data e o ETag etag;
+// -1 se os headers não cabem
+int cache_put_file(cache_t *cache, const char* fullpath, const char *data, size_t size,
+                   const char *etag);
+// miss: lê o ficheiro do fd de file, guarda-o na cache e envia; a partir de
+// CACHE_MAX_FILE_SIZE guarda e envia-o aos pedaços de CACHE_CHUNK_SIZE
+long send_file_with_cache(out_queue_t *out, const char* fullpath, int send_body, cache_t *cache,
+                          stat_cache_t *stat_cache, stat_entry_t *file);
+long send_json_response(out_queue_t *out, const char* json_body, int send_body);
+long send_html_response(out_queue_t *out, const char* html_body, int send_body);
 void generate_dashboard_html(char *buffer, size_t buffer_size);
 
 #endif
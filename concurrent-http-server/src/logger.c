@@ -73,24 +73,21 @@ void destroy_logger(logger_t *logger) {
     free(logger);
 }
 
-void log_request(logger_t *logger,
-                const char *method,
-                const char *path,
-                const char *version,
-                int status_code,
-                long bytes_sent)
+int log_format_request(char *buf, size_t size,
+                       const char *method,
+                       const char *path,
+                       const char *version,
+                       int status_code,
+                       long bytes_sent)
 {
-    if (!logger || logger->log_fd < 0) return;
-    
     char timebuf[64];
     time_t now = time(NULL);
     struct tm tm_buf;
     struct tm *lt = gmtime_r(&now, &tm_buf);
-    if (!lt) return;
+    if (!lt) return -1;
     strftime(timebuf, sizeof(timebuf), "%d/%b/%Y:%H:%M:%S +0000", lt);
 
-    char log_line[1024];
-    int len = snprintf(log_line, sizeof(log_line),
+    int len = snprintf(buf, size,
                        "- - - [%s] \"%s %s %s\" %d %ld \"-\" \"-\"\n",
                        timebuf,
                        method  ? method  : "-",
@@ -98,16 +95,36 @@ void log_request(logger_t *logger,
                        version ? version : "-",
                        status_code,
                        bytes_sent);
-    
-    if (len <= 0 || len >= (int)sizeof(log_line)) return;
+    return (len <= 0 || len >= (int)size) ? -1 : len;
+}
+
+void log_write_lines(logger_t *logger, const char *lines, size_t len) {
+    if (!logger || logger->log_fd < 0 || len == 0) return;
 
     sem_wait(logger->sems->log);
     check_and_rotate_log(logger);
     
-    ssize_t written = write(logger->log_fd, log_line, len);
+    ssize_t written = write(logger->log_fd, lines, len);
     if (written < 0) {
         perror("write log");
     }
     
     sem_post(logger->sems->log);
 }
+
+void log_request(logger_t *logger,
+                const char *method,
+                const char *path,
+                const char *version,
+                int status_code,
+                long bytes_sent)
+{
+    if (!logger || logger->log_fd < 0) return;
+
+    char log_line[1024];
+    int len = log_format_request(log_line, sizeof(log_line), method, path, version,
+                                 status_code, bytes_sent);
+    if (len < 0) return;
+
+    log_write_lines(logger, log_line, (size_t)len);
+}
@@ -13,6 +13,15 @@ typedef struct {
 
 logger_t* create_logger(semaphores_t *sems, server_config_t *config);
 void destroy_logger(logger_t *logger);
+// linha no formato do log em buf; devolve o comprimento ou -1 se não cabe
+int log_format_request(char *buf, size_t size,
+                       const char *method,
+                       const char *path,
+                       const char *version,
+                       int status_code,
+                       long bytes_sent);
+// escreve linhas já formatadas (uma ou um lote) num só write
+void log_write_lines(logger_t *logger, const char *lines, size_t len);
 void log_request(logger_t *logger,
                 const char *method,
                 const char *path,
@@ -17,16 +17,22 @@
 #include "config.h"
 #include "worker.h"
 #include "stats.h"
+#include "cache.h"
+#include "watcher.h"
+#include "warmup.h"
 #include "master.h"
 
 extern volatile sig_atomic_t worker_shutdown;
 
 static volatile sig_atomic_t shutdown_requested = 0;
-static int global_server_fd = -1;
+static int *global_listen_fds = NULL;
+static int global_num_listen_fds = 0;
 static pid_t *global_worker_pids = NULL;
 static int global_num_workers = 0;
 static shared_data_t *global_shared = NULL;
 static semaphores_t global_sems;
+static cache_t *global_cache = NULL;
+static watcher_t global_watcher = { .fd = -1 };
 
 static void sigchld_handler(int sig) {
     (void)sig;
@@ -50,12 +56,63 @@ static void shutdown_handler(int sig) {
             }
         }
     }
-    
-    if (global_server_fd >= 0) {
-        shutdown(global_server_fd, SHUT_RDWR);
-        close(global_server_fd);
-        global_server_fd = -1;
+}
+
+// cria um socket de escuta com SO_REUSEPORT; -1 em erro
+static int create_listen_socket(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
     }
+
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt failed");
+        close(fd);
+        return -1;
+    }
+
+    // SO_REUSEPORT: vários sockets na mesma porta, cada um com a sua fila de accept
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, 128) < 0) {
+        perror("listen failed");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// fecha os sockets de escuta exceto keep_fd (o do próprio worker)
+static void close_listen_sockets(int keep_fd) {
+    if (!global_listen_fds) return;
+
+    for (int i = 0; i < global_num_listen_fds; i++) {
+        if (global_listen_fds[i] >= 0 && global_listen_fds[i] != keep_fd) {
+            close(global_listen_fds[i]);
+        }
+    }
+    free(global_listen_fds);
+    global_listen_fds = NULL;
+    global_num_listen_fds = 0;
 }
 
 static void cleanup_resources(void) {
@@ -106,11 +163,17 @@ static void cleanup_resources(void) {
         global_shared = NULL;
     }
     
-    if (global_server_fd >= 0) {
-        close(global_server_fd);
-        global_server_fd = -1;
+    // o watcher usa a cache: pára antes de a destruir
+    watcher_stop(&global_watcher);
+
+    if (global_cache) {
+        printf("[SHUTDOWN] Destroying shared cache...\n");
+        cache_destroy(global_cache);
+        global_cache = NULL;
     }
     
+    close_listen_sockets(-1);
+    
     printf("[SHUTDOWN] Cleanup complete. Exiting.\n");
 }
 
@@ -138,43 +201,21 @@ int master_main(void) {
         exit(1);
     }
 
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    global_server_fd = server_fd;
-    if (server_fd < 0) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
-    }
-
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt failed");
-        close(server_fd);
+    // um socket de escuta por worker: o kernel reparte as conexões entre eles
+    global_listen_fds = malloc(config.num_workers * sizeof(int));
+    if (!global_listen_fds) {
+        perror("malloc listen_fds");
         exit(EXIT_FAILURE);
     }
-    
-    // SO_REUSEPORT: cada worker pode aceitar conexões independentemente
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt SO_REUSEPORT failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    struct sockaddr_in address;
-    memset(&address, 0, sizeof(address));
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(config.port);
-
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
+    global_num_listen_fds = config.num_workers;
+    for (int i = 0; i < config.num_workers; i++) {
+        global_listen_fds[i] = -1;
     }
-
-    if (listen(server_fd, 128) < 0) {
-        perror("listen failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
+    for (int i = 0; i < config.num_workers; i++) {
+        global_listen_fds[i] = create_listen_socket(config.port);
+        if (global_listen_fds[i] < 0) {
+            exit(EXIT_FAILURE);
+        }
     }
 
     struct sigaction sa;
@@ -185,7 +226,6 @@ int master_main(void) {
 
     if (sigaction(SIGCHLD, &sa, NULL) < 0) {
         perror("sigaction SIGCHLD");
-        close(server_fd);
         exit(EXIT_FAILURE);
     }
 
@@ -193,7 +233,6 @@ int master_main(void) {
     global_shared = shared;
     if (!shared) {
         fprintf(stderr, "Erro a criar memória partilhada\n");
-        close(server_fd);
         exit(EXIT_FAILURE);
     }
 
@@ -201,11 +240,33 @@ int master_main(void) {
     if (init_semaphores(&sems, config.max_queue_size) != 0) {
         fprintf(stderr, "Erro a criar semáforos\n");
         destroy_shared_memory(shared);
-        close(server_fd);
         exit(EXIT_FAILURE);
     }
     global_sems = sems;
 
+    // cache partilhada por todos os workers: uma cópia de cada ficheiro e
+    // CACHE_SIZE_MB é o orçamento total (dividido pelos shards), não por processo
+    size_t cache_bytes = (size_t)config.cache_size_mb * 1024 * 1024;
+    if (cache_bytes == 0) cache_bytes = 1 * 1024 * 1024;
+    cache_t *cache = cache_create(cache_bytes, 0, config.cache_policy, config.cache_huge_pages);
+    global_cache = cache;
+    if (!cache) {
+        fprintf(stderr, "Erro a criar cache partilhada\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // watches antes do warm-up: o que mudar entretanto fica em fila no inotify
+    int watching = watcher_init(&global_watcher, &config, cache) == 0;
+
+    // antes dos forks: os workers já arrancam com a cache cheia (as conexões
+    // que chegarem entretanto esperam no backlog dos sockets de escuta)
+    warmup_result_t warmup;
+    if (cache_warmup(cache, &config, &warmup) == 0) {
+        printf("MASTER: cache warm-up: %zu files, %zu KB in %.2f s\n",
+               warmup.files, warmup.bytes / 1024, warmup.seconds);
+        fflush(stdout);
+    }
+
     printf("MASTER: listening on port %d\n", config.port);
     printf("Creating %d worker processes with %d threads each...\n", 
            config.num_workers, config.threads_per_worker);
@@ -216,7 +277,6 @@ int master_main(void) {
     
     if (!worker_pids) {
         perror("malloc worker_pids");
-        close(server_fd);
         destroy_semaphores(&sems);
         destroy_shared_memory(shared);
         exit(EXIT_FAILURE);
@@ -238,7 +298,10 @@ int master_main(void) {
             global_worker_pids = NULL;
             global_num_workers = 0;
             
-            worker_loop(shared, &sems, &config, server_fd);
+            int listen_fd = global_listen_fds[i];
+            close_listen_sockets(listen_fd);
+            
+            worker_loop(shared, &sems, &config, cache, listen_fd, i);
             
             // worker_loop só retorna durante shutdown ou erro
             if (worker_shutdown) {
@@ -253,10 +316,11 @@ int master_main(void) {
         printf("[MASTER] Created worker %d with PID %d\n", i, pid);
     }
 
+    // cada worker ficou com o seu socket de escuta
+    close_listen_sockets(-1);
+
     pid_t stats_pid = fork();
     if (stats_pid == 0) {
-        close(server_fd);
-        
         while (1) {
             sleep(30);
 
@@ -273,9 +337,11 @@ int master_main(void) {
             printf("Bytes transferred:     %ld\n", shared->stats.bytes_transferred);
             printf("Avg response time:     %.4f s\n", avg_response_time);
             printf("Status 200:            %ld\n", shared->stats.status_200);
+            printf("Status 304:            %ld\n", shared->stats.status_304);
             printf("Status 400:            %ld\n", shared->stats.status_400);
             printf("Status 403:            %ld\n", shared->stats.status_403);
             printf("Status 404:            %ld\n", shared->stats.status_404);
+            printf("Status 416:            %ld\n", shared->stats.status_416);
             printf("Status 500:            %ld\n", shared->stats.status_500);
             printf("Status 501:            %ld\n", shared->stats.status_501);
             printf("Status 503:            %ld\n", shared->stats.status_503);
@@ -288,7 +354,14 @@ int master_main(void) {
         exit(0);
     }
 
-    printf("MASTER: Workers will accept connections using SO_REUSEPORT...\n");
+    // depois dos forks: a thread do watcher fica só no master
+    if (watching && watcher_start(&global_watcher) == 0) {
+        printf("MASTER: watching document roots for cache invalidation\n");
+    } else {
+        fprintf(stderr, "MASTER: inotify indisponível, a cache não é invalidada por alterações no disco\n");
+    }
+
+    printf("MASTER: Each worker accepts on its own SO_REUSEPORT socket...\n");
     printf("Press Ctrl+C to shutdown gracefully...\n");
 
     while (!shutdown_requested) {
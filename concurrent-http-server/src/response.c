@@ -0,0 +1,665 @@
+#define _GNU_SOURCE
+
+#include "response.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+void http_date(char *buf, size_t size) {
+    // o valor só muda uma vez por segundo: gmtime_r/strftime só quando muda
+    static __thread time_t cached_at = -1;
+    static __thread char cached[HTTP_DATE_SIZE];
+
+    time_t now = time(NULL);
+    if (now != cached_at) {
+        struct tm tm_buf;
+        struct tm *gmt = gmtime_r(&now, &tm_buf);
+        if (!gmt || strftime(cached, sizeof(cached), "%a, %d %b %Y %H:%M:%S GMT", gmt) == 0) {
+            strcpy(cached, "Thu, 01 Jan 1970 00:00:00 GMT");
+        }
+        cached_at = now;
+    }
+
+    strncpy(buf, cached, size - 1);
+    buf[size - 1] = '\0';
+}
+
+void http_etag(char *buf, size_t size, const struct stat *st) {
+    unsigned long long mtime_ns = (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL +
+                                  (unsigned long long)st->st_mtim.tv_nsec;
+    snprintf(buf, size, "\"%llx-%llx-%llx\"",
+             (unsigned long long)st->st_ino, (unsigned long long)st->st_size, mtime_ns);
+}
+
+int build_response_headers(char *buf, size_t size,
+                           const char *status_line,
+                           const char *content_type,
+                           long content_length,
+                           const char *extra_headers,
+                           const char *connection)
+{
+    char date_header[HTTP_DATE_SIZE];
+    http_date(date_header, sizeof(date_header));
+
+    int len = snprintf(buf, size,
+        "%s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %ld\r\n"
+        "Server: ConcurrentHTTP/1.0\r\n"
+        "Date: %s\r\n"
+        "%s"
+        "Connection: %s\r\n"
+        "\r\n",
+        status_line, content_type, content_length, date_header,
+        extra_headers ? extra_headers : "", connection);
+
+    if (len < 0 || (size_t)len >= size) return -1;
+    return len;
+}
+
+int build_prebuilt_headers(char *buf, size_t size,
+                           const char *status_line,
+                           const char *content_type,
+                           long content_length,
+                           const char *etag,
+                           size_t *date_off,
+                           size_t *etag_off)
+{
+    // mesma ordem de build_response_headers, até Date inclusive
+    int len = snprintf(buf, size,
+        "%s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %ld\r\n"
+        "Server: ConcurrentHTTP/1.0\r\n"
+        "Date: ",
+        status_line, content_type, content_length);
+    if (len < 0 || (size_t)len + HTTP_DATE_LEN + 2 >= size) return -1;
+
+    *date_off = (size_t)len;
+    memset(buf + len, ' ', HTTP_DATE_LEN);
+    memcpy(buf + len + HTTP_DATE_LEN, "\r\n", 2);
+    len += HTTP_DATE_LEN + 2;
+
+    // o ETag vem a seguir, como nos extra_headers das respostas não guardadas
+    if (etag) {
+        int n = snprintf(buf + len, size - (size_t)len, "ETag: %s\r\n", etag);
+        if (n < 0 || (size_t)(len + n) >= size) return -1;
+        *etag_off = (size_t)len + 6;
+        len += n;
+    }
+    return len;
+}
+
+// escreve sem bloquear; devolve bytes escritos (pára em EAGAIN), *error em falha
+static size_t writev_some(int fd, struct iovec *iov, int iovcnt, int flags, int *error) {
+    size_t total = 0;
+
+    while (iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)iovcnt;
+
+        ssize_t n = sendmsg(fd, &msg, flags | MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) *error = 1;
+            break;
+        }
+        total += (size_t)n;
+
+        // avança sobre os iovecs já enviados (escrita parcial)
+        size_t left = (size_t)n;
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return total;
+}
+
+// sendfile sem bloquear (o socket é O_NONBLOCK); devolve bytes escritos
+static size_t sendfile_some(int fd, int file_fd, off_t offset, size_t count, int *error) {
+    size_t sent = 0;
+    while (sent < count) {
+        ssize_t n = sendfile(fd, file_fd, &offset, count - sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) *error = 1;
+            break;
+        }
+        if (n == 0) {
+            // ficheiro truncado entretanto: Content-Length já não pode ser cumprido
+            *error = 1;
+            break;
+        }
+        sent += (size_t)n;
+    }
+    return sent;
+}
+
+void out_queue_init(out_queue_t *q, int fd) {
+    q->fd = fd;
+    q->head = NULL;
+    q->tail = NULL;
+    q->queued = 0;
+    q->bytes_sent = 0;
+    q->error = 0;
+    q->corked = 0;
+    q->keep_alive = 1;
+}
+
+static void pin_release(const out_pin_t *pin) {
+    if (pin && pin->release) pin->release(pin->owner, pin->ref);
+}
+
+// com pin o fd é emprestado: fica aberto para o dono do pin
+static void drop_file(int file_fd, const out_pin_t *pin) {
+    if (pin && pin->release) pin_release(pin);
+    else close(file_fd);
+}
+
+static void free_seg(out_seg_t *seg) {
+    if (seg->source.next) {
+        pin_release(&seg->piece.pin);
+        if (seg->source.release) seg->source.release(seg->source.ctx);
+    } else if (seg->file_fd >= 0) {
+        drop_file(seg->file_fd, &seg->pin);
+    } else {
+        pin_release(&seg->pin);
+    }
+    free(seg);
+}
+
+void out_queue_reset(out_queue_t *q) {
+    out_seg_t *seg = q->head;
+    while (seg) {
+        out_seg_t *next = seg->next;
+        free_seg(seg);
+        seg = next;
+    }
+    q->head = NULL;
+    q->tail = NULL;
+    q->queued = 0;
+}
+
+static void append_seg(out_queue_t *q, out_seg_t *seg) {
+    seg->next = NULL;
+    if (q->tail) q->tail->next = seg;
+    else q->head = seg;
+    q->tail = seg;
+    q->queued += seg->len - seg->pos;
+}
+
+// copia para a fila os bytes dos iovecs a partir de skip
+static int append_copy(out_queue_t *q, struct iovec *iov, int iovcnt, size_t skip, size_t len) {
+    out_seg_t *seg = malloc(sizeof(out_seg_t) + len);
+    if (!seg) {
+        q->error = 1;
+        return -1;
+    }
+    seg->file_fd = -1;
+    seg->offset = 0;
+    seg->len = len;
+    seg->pos = 0;
+    seg->ext = NULL;
+    seg->pin.release = NULL;
+    seg->source.next = NULL;
+
+    size_t copied = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t ilen = iov[i].iov_len;
+        const char *base = iov[i].iov_base;
+        if (skip >= ilen) {
+            skip -= ilen;
+            continue;
+        }
+        memcpy(seg->data + copied, base + skip, ilen - skip);
+        copied += ilen - skip;
+        skip = 0;
+    }
+    append_seg(q, seg);
+    return 0;
+}
+
+// guarda por referência len bytes de data; a fila fica com o pin
+static int append_ref(out_queue_t *q, const char *data, size_t len, const out_pin_t *pin) {
+    out_seg_t *seg = malloc(sizeof(out_seg_t));
+    if (!seg) {
+        pin_release(pin);
+        q->error = 1;
+        return -1;
+    }
+    seg->file_fd = -1;
+    seg->offset = 0;
+    seg->len = len;
+    seg->pos = 0;
+    seg->ext = data;
+    seg->pin = *pin;
+    seg->source.next = NULL;
+    append_seg(q, seg);
+    return 0;
+}
+
+// guarda o que falta a partir de skip: com pin, o último iovec vai por referência
+static int append_rest(out_queue_t *q, struct iovec *iov, int iovcnt, size_t skip,
+                       size_t total, const out_pin_t *pin) {
+    if (!pin) return append_copy(q, iov, iovcnt, skip, total - skip);
+
+    size_t body_len = iov[iovcnt - 1].iov_len;
+    size_t head_len = total - body_len;
+    if (skip < head_len && append_copy(q, iov, iovcnt - 1, skip, head_len - skip) != 0) {
+        pin_release(pin);
+        return -1;
+    }
+
+    size_t body_skip = skip > head_len ? skip - head_len : 0;
+    return append_ref(q, (const char*)iov[iovcnt - 1].iov_base + body_skip,
+                      body_len - body_skip, pin);
+}
+
+static long queue_write(out_queue_t *q, struct iovec *iov, int iovcnt, int more,
+                        const out_pin_t *pin) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+    if (q->error) {
+        pin_release(pin);
+        return 0;
+    }
+
+    // pipeline: respostas pequenas ficam em fila e saem juntas no uncork
+    if (q->corked) {
+        if (q->queued + total <= OUT_CORK_MAX) {
+            return append_rest(q, iov, iovcnt, 0, total, pin) == 0 ? (long)total : 0;
+        }
+        out_queue_flush(q);
+        if (q->error) {
+            pin_release(pin);
+            return 0;
+        }
+    }
+
+    // só escreve diretamente se não houver nada à frente na fila
+    size_t written = 0;
+    if (!q->head) {
+        written = writev_some(q->fd, iov, iovcnt, more ? MSG_MORE : 0, &q->error);
+        q->bytes_sent += (long)written;
+        if (q->error || written == total) {
+            pin_release(pin);
+            return (long)(q->error ? written : total);
+        }
+    }
+
+    // copia (ou referencia) apenas o que ficou por enviar
+    if (append_rest(q, iov, iovcnt, written, total, pin) != 0) return (long)written;
+    return (long)total;
+}
+
+long out_queue_write(out_queue_t *q, struct iovec *iov, int iovcnt, int more) {
+    return queue_write(q, iov, iovcnt, more, NULL);
+}
+
+long out_queue_write_pinned(out_queue_t *q, struct iovec *iov, int iovcnt, int more,
+                            const out_pin_t *pin) {
+    return queue_write(q, iov, iovcnt, more, pin);
+}
+
+static long queue_sendfile(out_queue_t *q, int file_fd, off_t offset, size_t len,
+                           const out_pin_t *pin) {
+    if (q->error || len == 0) {
+        drop_file(file_fd, pin);
+        return 0;
+    }
+
+    size_t written = 0;
+    if (!q->head && !q->corked) {
+        written = sendfile_some(q->fd, file_fd, offset, len, &q->error);
+        q->bytes_sent += (long)written;
+        if (q->error || written == len) {
+            drop_file(file_fd, pin);
+            return (long)(q->error ? written : len);
+        }
+    }
+
+    // o resto é enviado quando o socket voltar a ter espaço
+    out_seg_t *seg = malloc(sizeof(out_seg_t));
+    if (!seg) {
+        drop_file(file_fd, pin);
+        q->error = 1;
+        return (long)written;
+    }
+    seg->file_fd = file_fd;
+    seg->offset = offset;
+    seg->len = len;
+    seg->pos = written;
+    seg->ext = NULL;
+    seg->pin.release = NULL;
+    seg->source.next = NULL;
+    if (pin) seg->pin = *pin;
+    append_seg(q, seg);
+    return (long)len;
+}
+
+long out_queue_sendfile(out_queue_t *q, int file_fd, off_t offset, size_t len) {
+    return queue_sendfile(q, file_fd, offset, len, NULL);
+}
+
+long out_queue_sendfile_pinned(out_queue_t *q, int file_fd, off_t offset, size_t len,
+                               const out_pin_t *pin) {
+    return queue_sendfile(q, file_fd, offset, len, pin);
+}
+
+long out_queue_source(out_queue_t *q, off_t offset, size_t len, const out_source_t *source) {
+    if (q->error || len == 0) {
+        if (source->release) source->release(source->ctx);
+        return 0;
+    }
+
+    out_seg_t *seg = malloc(sizeof(out_seg_t));
+    if (!seg) {
+        if (source->release) source->release(source->ctx);
+        q->error = 1;
+        return 0;
+    }
+    seg->file_fd = -1;
+    seg->offset = offset;
+    seg->len = len;
+    seg->pos = 0;
+    seg->ext = NULL;
+    seg->pin.release = NULL;
+    seg->source = *source;
+    memset(&seg->piece, 0, sizeof(seg->piece));
+    seg->piece_pos = 0;
+    append_seg(q, seg);
+
+    // os pedaços só são pedidos quando o segmento chega à frente da fila
+    if (!q->corked && q->head == seg) out_queue_flush(q);
+    return (long)len;
+}
+
+// envia o pedaço atual de um segmento de fonte, pedindo o seguinte quando o
+// anterior acabou; devolve os bytes escritos e em *want os que havia para escrever
+static size_t flush_source(out_queue_t *q, out_seg_t *seg, size_t *want) {
+    *want = 0;
+    if (seg->piece_pos == seg->piece.len) {
+        pin_release(&seg->piece.pin);
+        memset(&seg->piece, 0, sizeof(seg->piece));
+        seg->piece_pos = 0;
+        if (seg->source.next(seg->source.ctx, seg->offset + (off_t)seg->pos, &seg->piece) != 0 ||
+            seg->piece.len == 0) {
+            pin_release(&seg->piece.pin);
+            memset(&seg->piece, 0, sizeof(seg->piece));
+            q->error = 1;
+            return 0;
+        }
+        if (seg->piece.len > seg->len - seg->pos) seg->piece.len = seg->len - seg->pos;
+    }
+
+    struct iovec iov;
+    iov.iov_base = (char*)seg->piece.data + seg->piece_pos;
+    iov.iov_len = seg->piece.len - seg->piece_pos;
+    *want = iov.iov_len;
+    int more = seg->pos + iov.iov_len < seg->len || seg->next;
+    size_t n = writev_some(q->fd, &iov, 1, more ? MSG_MORE : 0, &q->error);
+    seg->piece_pos += n;
+    seg->pos += n;
+    return n;
+}
+
+// retira da cabeça da fila os segmentos já enviados
+static void pop_sent(out_queue_t *q) {
+    while (q->head && q->head->pos == q->head->len) {
+        out_seg_t *seg = q->head;
+        q->head = seg->next;
+        if (!q->head) q->tail = NULL;
+        free_seg(seg);
+    }
+}
+
+int out_queue_flush(out_queue_t *q) {
+    while (q->head && !q->error) {
+        out_seg_t *seg = q->head;
+        size_t n, want;
+
+        if (seg->source.next) {
+            n = flush_source(q, seg, &want);
+        } else if (seg->file_fd < 0) {
+            // segmentos em memória consecutivos numa só chamada sendmsg
+            struct iovec iov[OUT_IOV_BATCH];
+            int iovcnt = 0;
+            out_seg_t *s = seg;
+            want = 0;
+            while (s && s->file_fd < 0 && !s->source.next && iovcnt < OUT_IOV_BATCH) {
+                iov[iovcnt].iov_base = (char*)(s->ext ? s->ext : s->data) + s->pos;
+                iov[iovcnt].iov_len = s->len - s->pos;
+                want += iov[iovcnt].iov_len;
+                iovcnt++;
+                s = s->next;
+            }
+            n = writev_some(q->fd, iov, iovcnt, s ? MSG_MORE : 0, &q->error);
+
+            // distribui os bytes escritos pelos segmentos
+            size_t left = n;
+            for (s = seg; left > 0; s = s->next) {
+                size_t part = s->len - s->pos;
+                if (part > left) part = left;
+                s->pos += part;
+                left -= part;
+            }
+        } else {
+            want = seg->len - seg->pos;
+            n = sendfile_some(q->fd, seg->file_fd, seg->offset + (off_t)seg->pos, want, &q->error);
+            seg->pos += n;
+        }
+        q->bytes_sent += (long)n;
+        q->queued -= n;
+        pop_sent(q);
+
+        // socket cheio
+        if (n < want && !q->error) return 0;
+    }
+    return q->error ? -1 : 1;
+}
+
+void out_queue_cork(out_queue_t *q) {
+    q->corked = 1;
+}
+
+int out_queue_uncork(out_queue_t *q) {
+    q->corked = 0;
+    return out_queue_flush(q);
+}
+
+// "close" explícito (respostas de erro) fecha a conexão depois da resposta
+static const char* connection_header(out_queue_t *out, const char *connection) {
+    if (connection && strcmp(connection, "close") == 0) out->keep_alive = 0;
+    return out->keep_alive ? "keep-alive" : "close";
+}
+
+long send_response_pinned(out_queue_t *out,
+                          const char *status_line,
+                          const char *content_type,
+                          const char *extra_headers,
+                          const char *connection,
+                          const char *body, size_t body_len,
+                          int send_body,
+                          const out_pin_t *pin)
+{
+    char headers[RESPONSE_HEADERS_SIZE];
+    int hlen = build_response_headers(headers, sizeof(headers), status_line, content_type,
+                                      (long)body_len, extra_headers,
+                                      connection_header(out, connection));
+    if (hlen < 0) {
+        pin_release(pin);
+        return 0;
+    }
+
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = headers;
+    iov[0].iov_len = (size_t)hlen;
+    if (send_body && body_len > 0) {
+        iov[1].iov_base = (void*)body;
+        iov[1].iov_len = body_len;
+        iovcnt = 2;
+    }
+
+    // sem corpo (HEAD) não há nada a manter vivo
+    if (iovcnt == 1) {
+        pin_release(pin);
+        pin = NULL;
+    }
+    return queue_write(out, iov, iovcnt, 0, pin);
+}
+
+long send_prebuilt_response(out_queue_t *out, const prebuilt_response_t *resp,
+                            int send_body, const out_pin_t *pin)
+{
+    static const char conn_prefix[] = "Connection: ";
+    const char *connection = connection_header(out, NULL);
+    size_t conn_len = strlen(connection);
+
+    char headers[RESPONSE_HEADERS_SIZE];
+    size_t hlen = resp->headers_len;
+    if (hlen + sizeof(conn_prefix) + conn_len + 4 > sizeof(headers)) {
+        pin_release(pin);
+        return 0;
+    }
+
+    // cópia dos headers guardados com o Date atual no slot
+    char date[HTTP_DATE_SIZE];
+    http_date(date, sizeof(date));
+    memcpy(headers, resp->headers, hlen);
+    memcpy(headers + resp->date_off, date, HTTP_DATE_LEN);
+
+    memcpy(headers + hlen, conn_prefix, sizeof(conn_prefix) - 1);
+    hlen += sizeof(conn_prefix) - 1;
+    memcpy(headers + hlen, connection, conn_len);
+    hlen += conn_len;
+    memcpy(headers + hlen, "\r\n\r\n", 4);
+    hlen += 4;
+
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = headers;
+    iov[0].iov_len = hlen;
+    if (send_body && resp->body_len > 0) {
+        iov[1].iov_base = (void*)resp->body;
+        iov[1].iov_len = resp->body_len;
+        iovcnt = 2;
+    } else {
+        pin_release(pin);
+        pin = NULL;
+    }
+    return queue_write(out, iov, iovcnt, 0, pin);
+}
+
+long send_not_modified(out_queue_t *out, const char *etag, size_t etag_len) {
+    char date_header[HTTP_DATE_SIZE];
+    http_date(date_header, sizeof(date_header));
+
+    char headers[RESPONSE_HEADERS_SIZE];
+    int hlen = snprintf(headers, sizeof(headers),
+        "HTTP/1.1 304 Not Modified\r\n"
+        "Server: ConcurrentHTTP/1.0\r\n"
+        "Date: %s\r\n"
+        "ETag: %.*s\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        date_header, (int)etag_len, etag, connection_header(out, NULL));
+    if (hlen < 0 || (size_t)hlen >= sizeof(headers)) return 0;
+
+    struct iovec iov;
+    iov.iov_base = headers;
+    iov.iov_len = (size_t)hlen;
+    return out_queue_write(out, &iov, 1, 0);
+}
+
+long send_response(out_queue_t *out,
+                   const char *status_line,
+                   const char *content_type,
+                   const char *extra_headers,
+                   const char *connection,
+                   const char *body, size_t body_len,
+                   int send_body)
+{
+    return send_response_pinned(out, status_line, content_type, extra_headers,
+                                connection, body, body_len, send_body, NULL);
+}
+
+long send_file_response(out_queue_t *out,
+                        const char *status_line,
+                        const char *content_type,
+                        const char *extra_headers,
+                        const char *connection,
+                        int file_fd, off_t offset, size_t length,
+                        int send_body, const out_pin_t *pin)
+{
+    char headers[RESPONSE_HEADERS_SIZE];
+    int hlen = build_response_headers(headers, sizeof(headers), status_line, content_type,
+                                      (long)length, extra_headers,
+                                      connection_header(out, connection));
+    if (hlen < 0) {
+        drop_file(file_fd, pin);
+        return 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base = headers;
+    iov.iov_len = (size_t)hlen;
+
+    // MSG_MORE: headers e início do corpo seguem no mesmo segmento TCP
+    int more = send_body && length > 0;
+    long total_sent = out_queue_write(out, &iov, 1, more);
+
+    if (send_body) {
+        total_sent += queue_sendfile(out, file_fd, offset, length, pin);
+    } else {
+        drop_file(file_fd, pin);
+    }
+    return total_sent;
+}
+
+long send_source_response(out_queue_t *out,
+                          const char *status_line,
+                          const char *content_type,
+                          const char *extra_headers,
+                          const char *connection,
+                          off_t offset, size_t length,
+                          int send_body, const out_source_t *source)
+{
+    char headers[RESPONSE_HEADERS_SIZE];
+    int hlen = build_response_headers(headers, sizeof(headers), status_line, content_type,
+                                      (long)length, extra_headers,
+                                      connection_header(out, connection));
+    if (hlen < 0) {
+        if (source->release) source->release(source->ctx);
+        return 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base = headers;
+    iov.iov_len = (size_t)hlen;
+
+    int more = send_body && length > 0;
+    long total_sent = out_queue_write(out, &iov, 1, more);
+
+    if (send_body) {
+        total_sent += out_queue_source(out, offset, length, source);
+    } else if (source->release) {
+        source->release(source->ctx);
+    }
+    return total_sent;
+}
@@ -0,0 +1,190 @@
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#define HTTP_DATE_SIZE 64
+#define HTTP_DATE_LEN  29          // "Thu, 01 Jan 1970 00:00:00 GMT"
+#define HTTP_ETAG_SIZE 64          // "inode-tamanho-mtime" em hexadecimal, com aspas
+#define RESPONSE_HEADERS_SIZE 1024
+#define OUT_CORK_MAX  (16 * 1024)  // bytes acumulados de respostas em pipeline antes de enviar
+#define OUT_IOV_BATCH 64           // segmentos em memória por chamada sendmsg
+
+// memória de terceiros (ex: entrada da cache) que a fila envia sem copiar;
+// release é chamado quando os bytes saem ou a fila é descartada
+typedef struct {
+    void (*release)(void *owner, void *ref);
+    void *owner;
+    void *ref;
+} out_pin_t;
+
+// pedaço de um intervalo produzido por uma fonte, por referência e fixado
+typedef struct {
+    const char *data;
+    size_t      len;
+    out_pin_t   pin;
+} out_piece_t;
+
+// intervalo produzido aos pedaços só quando chega à frente da fila (ex: ficheiro
+// grande montado a partir dos pedaços da cache): next preenche *piece com os
+// bytes a partir de offset e devolve 0, ou -1 em erro; release larga ctx
+typedef struct {
+    int  (*next)(void *ctx, off_t offset, out_piece_t *piece);
+    void (*release)(void *ctx);
+    void *ctx;
+} out_source_t;
+
+// segmento ainda por enviar: cópia em memória, referência fixada, intervalo de
+// ficheiro ou fonte
+typedef struct out_seg {
+    struct out_seg *next;
+    int     file_fd;   // -1: segmento em memória
+    off_t   offset;    // ficheiro: posição inicial do intervalo
+    size_t  len;
+    size_t  pos;       // bytes já enviados
+    const char *ext;   // não NULL: dados por referência, mantidos vivos por pin
+    out_pin_t   pin;
+    out_source_t source;  // next não NULL: segmento de uma fonte, a partir de offset
+    out_piece_t  piece;   // pedaço atual da fonte
+    size_t       piece_pos;
+    char    data[];
+} out_seg_t;
+
+// saída de uma conexão (socket não bloqueante); o que o socket
+// não aceita logo fica em fila até haver espaço para escrever
+typedef struct {
+    int        fd;
+    out_seg_t *head;
+    out_seg_t *tail;
+    size_t     queued;      // bytes em fila por enviar
+    long       bytes_sent;  // bytes efetivamente escritos no socket
+    int        error;       // escrita falhou: a conexão deve ser fechada
+    int        corked;      // acumula respostas pequenas até out_queue_uncork
+    int        keep_alive;  // header Connection das respostas; "close" explícito limpa-o
+} out_queue_t;
+
+void out_queue_init(out_queue_t *q, int fd);
+
+// descarta o que estiver pendente (fecha os ficheiros em fila)
+void out_queue_reset(out_queue_t *q);
+
+static inline int out_queue_pending(const out_queue_t *q) {
+    return q->head != NULL;
+}
+
+// escreve o que o socket aceitar e copia só o resto para a fila
+// devolve o tamanho total aceite ou os bytes escritos antes de um erro
+long out_queue_write(out_queue_t *q, struct iovec *iov, int iovcnt, int more);
+
+// como out_queue_write, mas o último iovec fica por referência (sem cópia) até ser enviado;
+// a fila fica com a posse de pin
+long out_queue_write_pinned(out_queue_t *q, struct iovec *iov, int iovcnt, int more,
+                            const out_pin_t *pin);
+
+// intervalo de ficheiro via sendfile; a fila fica com a posse de file_fd
+long out_queue_sendfile(out_queue_t *q, int file_fd, off_t offset, size_t len);
+
+// como out_queue_sendfile, mas file_fd é emprestado (ex: fd da stat_cache):
+// a fila não o fecha e larga pin quando o intervalo sai ou é descartado
+long out_queue_sendfile_pinned(out_queue_t *q, int file_fd, off_t offset, size_t len,
+                               const out_pin_t *pin);
+
+// len bytes de source, pedidos à medida que o socket os aceita; a fila fica
+// com a posse de source
+long out_queue_source(out_queue_t *q, off_t offset, size_t len, const out_source_t *source);
+
+// retoma o envio: 1 se tudo enviado, 0 se o socket ficou cheio, -1 em erro
+int out_queue_flush(out_queue_t *q);
+
+// respostas a pedidos em pipeline saem juntas no uncork (uma só chamada sendmsg)
+void out_queue_cork(out_queue_t *q);
+int out_queue_uncork(out_queue_t *q);
+
+// resposta guardada já serializada (cache): status line e headers até Date, e corpo
+typedef struct {
+    const char *headers;      // sem Connection nem a linha em branco final
+    size_t      headers_len;
+    size_t      date_off;     // slot de HTTP_DATE_LEN bytes com o valor de Date
+    size_t      etag_off;     // valor do ETag dentro dos headers
+    size_t      etag_len;     // 0: sem ETag
+    const char *body;
+    size_t      body_len;
+} prebuilt_response_t;
+
+// data atual no formato HTTP (RFC 7231); formatada uma vez por segundo por thread
+void http_date(char *buf, size_t size);
+
+// ETag forte de um ficheiro: muda com o inode, o tamanho ou o mtime (ns)
+void http_etag(char *buf, size_t size, const struct stat *st);
+
+// status line + headers comuns; extra_headers (pode ser NULL) já vem com "\r\n"
+// devolve o tamanho escrito ou -1 se não couber
+int build_response_headers(char *buf, size_t size,
+                           const char *status_line,
+                           const char *content_type,
+                           long content_length,
+                           const char *extra_headers,
+                           const char *connection);
+
+// parte fixa dos headers de uma resposta a guardar pré-serializada
+// devolve o tamanho escrito ou -1; *date_off recebe a posição do slot de Date
+// e, com etag (pode ser NULL), *etag_off a do valor do ETag
+int build_prebuilt_headers(char *buf, size_t size,
+                           const char *status_line,
+                           const char *content_type,
+                           long content_length,
+                           const char *etag,
+                           size_t *date_off,
+                           size_t *etag_off);
+
+// envia uma resposta pré-serializada: copia os headers, atualiza Date e junta Connection
+// o corpo segue por referência; a fila fica com a posse de pin (pode ser NULL)
+long send_prebuilt_response(out_queue_t *out, const prebuilt_response_t *resp,
+                            int send_body, const out_pin_t *pin);
+
+// 304 Not Modified: só headers (Date, ETag, Connection), sem corpo nem Content-Length
+long send_not_modified(out_queue_t *out, const char *etag, size_t etag_len);
+
+// headers e corpo em memória numa só chamada sendmsg
+// connection: NULL segue out->keep_alive; "close" fecha a conexão depois da resposta
+long send_response(out_queue_t *out,
+                   const char *status_line,
+                   const char *content_type,
+                   const char *extra_headers,
+                   const char *connection,
+                   const char *body, size_t body_len,
+                   int send_body);
+
+// send_response com o corpo por referência (zero-copy); a fila fica com a posse de pin
+long send_response_pinned(out_queue_t *out,
+                          const char *status_line,
+                          const char *content_type,
+                          const char *extra_headers,
+                          const char *connection,
+                          const char *body, size_t body_len,
+                          int send_body,
+                          const out_pin_t *pin);
+
+// headers seguidos do intervalo [offset, offset+length) do ficheiro via sendfile
+// sem pin a posse de file_fd passa para a fila de saída; com pin fica emprestado
+long send_file_response(out_queue_t *out,
+                        const char *status_line,
+                        const char *content_type,
+                        const char *extra_headers,
+                        const char *connection,
+                        int file_fd, off_t offset, size_t length,
+                        int send_body, const out_pin_t *pin);
+
+// headers seguidos de length bytes de source (ver out_queue_source)
+long send_source_response(out_queue_t *out,
+                          const char *status_line,
+                          const char *content_type,
+                          const char *extra_headers,
+                          const char *connection,
+                          off_t offset, size_t length,
+                          int send_body, const out_source_t *source);
+
+#endif
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+
+#define SCHED_SPIN_ROUNDS 16
+
+static int queue_init(work_queue_t *q, int capacity) {
+    size_t cap = 1;
+    while (cap < (size_t)capacity) cap <<= 1;
+
+    q->slots = calloc(cap, sizeof(*q->slots));
+    if (!q->slots) return -1;
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return 0;
+}
+
+// só o produtor escreve tail
+static int queue_push(work_queue_t *q, void *item) {
+    size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t h = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (t - h > q->mask) return -1;  // cheia
+
+    atomic_store_explicit(&q->slots[t & q->mask], item, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+    return 0;
+}
+
+// dona e ladrões competem pela cabeça; o slot só é reutilizado depois do CAS
+static void* queue_pop(work_queue_t *q) {
+    size_t h = atomic_load_explicit(&q->head, memory_order_acquire);
+    for (;;) {
+        size_t t = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (h >= t) return NULL;
+
+        void *item = atomic_load_explicit(&q->slots[h & q->mask], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&q->head, &h, h + 1,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+            return item;
+        }
+        // CAS falhou: h foi atualizado com a cabeça atual
+    }
+}
+
+int scheduler_init(scheduler_t *s, int num_workers, int capacity) {
+    if (num_workers <= 0 || capacity <= 0) return -1;
+
+    s->workers = calloc((size_t)num_workers, sizeof(sched_worker_t));
+    if (!s->workers) return -1;
+    s->num_workers = num_workers;
+    s->next = 0;
+    atomic_init(&s->num_sleeping, 0);
+    atomic_init(&s->stopping, 0);
+
+    for (int i = 0; i < num_workers; i++) {
+        if (queue_init(&s->workers[i].queue, capacity) != 0) {
+            for (int j = 0; j < i; j++) {
+                free(s->workers[j].queue.slots);
+                sem_destroy(&s->workers[j].wake);
+            }
+            free(s->workers);
+            return -1;
+        }
+        atomic_init(&s->workers[i].sleeping, 0);
+        sem_init(&s->workers[i].wake, 0, 0);
+    }
+    return 0;
+}
+
+void scheduler_destroy(scheduler_t *s) {
+    for (int i = 0; i < s->num_workers; i++) {
+        free(s->workers[i].queue.slots);
+        sem_destroy(&s->workers[i].wake);
+    }
+    free(s->workers);
+    s->workers = NULL;
+    s->num_workers = 0;
+}
+
+// acorda w se estiver parado; 1 se acordou
+static int wake_worker(scheduler_t *s, sched_worker_t *w) {
+    if (atomic_load(&w->sleeping) && atomic_exchange(&w->sleeping, 0)) {
+        atomic_fetch_sub(&s->num_sleeping, 1);
+        sem_post(&w->wake);
+        return 1;
+    }
+    return 0;
+}
+
+int scheduler_submit(scheduler_t *s, void *item) {
+    int n = s->num_workers;
+
+    for (;;) {
+        if (atomic_load(&s->stopping)) return -1;
+
+        // round-robin, saltando filas cheias
+        for (int i = 0; i < n; i++) {
+            int target = s->next;
+            s->next = (s->next + 1) % n;
+            if (queue_push(&s->workers[target].queue, item) != 0) continue;
+
+            // store-load: o tail publicado (release) tem de ficar ordenado antes
+            // da leitura de sleeping, senão a dona pode ler o tail antigo e
+            // dormir enquanto aqui se lê sleeping == 0
+            atomic_thread_fence(memory_order_seq_cst);
+
+            // a dona está parada: acorda-a; senão acorda outra que lhe possa roubar
+            if (!wake_worker(s, &s->workers[target]) && atomic_load(&s->num_sleeping) > 0) {
+                for (int j = 1; j < n; j++) {
+                    if (wake_worker(s, &s->workers[(target + j) % n])) break;
+                }
+            }
+            return 0;
+        }
+
+        // todas as filas cheias: as threads do pool estão a consumir
+        sched_yield();
+    }
+}
+
+int scheduler_depth(scheduler_t *s) {
+    size_t depth = 0;
+    for (int i = 0; i < s->num_workers; i++) {
+        work_queue_t *q = &s->workers[i].queue;
+        size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+        size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        if (t > h) depth += t - h;
+    }
+    return (int)depth;
+}
+
+// própria fila primeiro, depois rouba às outras a partir da vizinha
+static void* find_work(scheduler_t *s, int id) {
+    void *item = queue_pop(&s->workers[id].queue);
+    if (item) return item;
+
+    for (int i = 1; i < s->num_workers; i++) {
+        item = queue_pop(&s->workers[(id + i) % s->num_workers].queue);
+        if (item) return item;
+    }
+    return NULL;
+}
+
+void* scheduler_next(scheduler_t *s, int id) {
+    sched_worker_t *self = &s->workers[id];
+
+    for (;;) {
+        // antes de dormir cede o CPU algumas vezes: o produtor costuma ter
+        // mais trabalho logo a seguir e evita-se o par sem_post/sem_wait
+        for (int spin = 0; spin < SCHED_SPIN_ROUNDS; spin++) {
+            if (atomic_load(&s->stopping)) return NULL;
+
+            void *item = find_work(s, id);
+            if (item) return item;
+            sched_yield();
+        }
+
+        // anuncia que vai parar e volta a procurar; com a fence do submit
+        // (par store-load dos dois lados) pelo menos um vê a escrita do outro:
+        // o submit vê sleeping == 1 e acorda-a, ou o item já é visível aqui
+        atomic_store(&self->sleeping, 1);
+        atomic_fetch_add(&s->num_sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        void *item = find_work(s, id);
+        if (item || atomic_load(&s->stopping)) {
+            if (atomic_exchange(&self->sleeping, 0)) {
+                atomic_fetch_sub(&s->num_sleeping, 1);
+            }
+            // senão o produtor já fez sem_post: o próximo sem_wait retorna logo
+            if (item) return item;
+            return NULL;
+        }
+
+        while (sem_wait(&self->wake) != 0 && errno == EINTR) {
+        }
+    }
+}
+
+void scheduler_stop(scheduler_t *s) {
+    atomic_store(&s->stopping, 1);
+    for (int i = 0; i < s->num_workers; i++) {
+        sem_post(&s->workers[i].wake);
+    }
+}
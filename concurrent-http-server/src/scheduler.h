@@ -0,0 +1,51 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+// fila lock-free de um só produtor (o event loop) e vários consumidores:
+// a thread dona e as que lhe roubam trabalho retiram da cabeça com CAS
+typedef struct {
+    _Atomic size_t head;
+    char           pad[64 - sizeof(size_t)];  // head e tail em cache lines distintas
+    _Atomic size_t tail;
+    size_t         mask;
+    void *_Atomic *slots;
+} work_queue_t;
+
+typedef struct {
+    work_queue_t queue;
+    atomic_int   sleeping;  // 1 enquanto espera em wake
+    sem_t        wake;
+} sched_worker_t;
+
+// escalonador com work stealing: uma fila por thread do pool
+typedef struct {
+    sched_worker_t *workers;
+    int             num_workers;
+    int             next;          // round-robin do produtor
+    atomic_int      num_sleeping;
+    atomic_int      stopping;
+} scheduler_t;
+
+// capacity: itens por fila (arredondado para potência de 2)
+int scheduler_init(scheduler_t *s, int num_workers, int capacity);
+void scheduler_destroy(scheduler_t *s);
+
+// produtor único: entrega item a uma fila (round-robin) e acorda uma thread parada
+// se todas as filas estiverem cheias espera por espaço; -1 se o escalonador parou
+int scheduler_submit(scheduler_t *s, void *item);
+
+// produtor: itens à espera em todas as filas (aproximado se houver consumidores ativos)
+int scheduler_depth(scheduler_t *s);
+
+// thread id: próximo item da própria fila ou roubado a outra; bloqueia se não houver
+// devolve NULL depois de scheduler_stop
+void* scheduler_next(scheduler_t *s, int id);
+
+// acorda todas as threads; scheduler_next passa a devolver NULL
+void scheduler_stop(scheduler_t *s);
+
+#endif
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include "stat_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned long current_generation(stat_cache_t *sc) {
+    return sc->cache ? cache_generation(sc->cache) : 0;
+}
+
+stat_cache_t* stat_cache_create(cache_t *cache, int ttl_ms) {
+    stat_cache_t *sc = calloc(1, sizeof(stat_cache_t));
+    if (!sc) return NULL;
+
+    for (int i = 0; i < STAT_CACHE_LOCKS; i++) {
+        pthread_mutex_init(&sc->locks[i], NULL);
+    }
+    sc->cache = cache;
+    sc->ttl_ns = ttl_ms > 0 ? (uint64_t)ttl_ms * 1000000ULL : 0;
+    return sc;
+}
+
+void stat_cache_destroy(stat_cache_t *sc) {
+    if (!sc) return;
+    for (int i = 0; i < STAT_CACHE_SLOTS; i++) {
+        if (sc->slots[i]) stat_cache_release(sc, sc->slots[i]);
+    }
+    for (int i = 0; i < STAT_CACHE_LOCKS; i++) {
+        pthread_mutex_destroy(&sc->locks[i]);
+    }
+    free(sc);
+}
+
+void stat_cache_release(stat_cache_t *sc, stat_entry_t *entry) {
+    (void)sc;
+    if (atomic_fetch_sub_explicit(&entry->refs, 1, memory_order_acq_rel) == 1) {
+        if (entry->fd >= 0) close(entry->fd);
+        free(entry);
+    }
+}
+
+// muda sempre que o ficheiro é substituído (inode) ou escrito (mtime, tamanho)
+static uint64_t file_tag(const struct stat *st) {
+    uint64_t v[5] = { (uint64_t)st->st_ino, (uint64_t)st->st_dev, (uint64_t)st->st_size,
+                      (uint64_t)st->st_mtim.tv_sec, (uint64_t)st->st_mtim.tv_nsec };
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < 5; i++) {
+        h ^= v[i];
+        h *= 1099511628211ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// open + fstat: o fd aberto serve o próprio pedido e os seguintes
+static int resolve(const char *path, uint64_t hash, stat_entry_t **out) {
+    *out = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ENOTDIR) return 404;
+        if (errno != EACCES) return 500;   // EMFILE e afins: passageiro, não fica em cache
+    }
+
+    struct stat st;
+    int status = 403;
+    if (fd >= 0) {
+        status = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? 200 : 500;
+        if (status != 200) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    size_t path_len = strlen(path);
+    stat_entry_t *e = malloc(sizeof(stat_entry_t) + path_len + 1);
+    if (!e) {
+        if (fd >= 0) close(fd);
+        return 500;
+    }
+    memset(e, 0, sizeof(*e));
+    e->hash = hash;
+    e->status = status;
+    e->fd = fd;
+    if (fd >= 0) {
+        e->size = st.st_size;
+        e->mtime = st.st_mtim;
+        e->ino = st.st_ino;
+        e->dev = st.st_dev;
+        e->tag = file_tag(&st);
+        http_etag(e->etag, sizeof(e->etag), &st);
+    }
+    memcpy(e->path, path, path_len + 1);
+    atomic_init(&e->refs, 1);
+    *out = e;
+    return status;
+}
+
+int stat_cache_lookup(stat_cache_t *sc, const char *path, stat_entry_t **entry) {
+    *entry = NULL;
+    uint64_t hash = cache_hash_path(path);
+    size_t slot = hash & (STAT_CACHE_SLOTS - 1);
+    pthread_mutex_t *lock = &sc->locks[slot % STAT_CACHE_LOCKS];
+
+    // a geração é lida antes do open: uma invalidação a meio deixa a entrada já velha
+    uint64_t now = monotonic_ns();
+    unsigned long generation = current_generation(sc);
+
+    if (sc->ttl_ns) {
+        pthread_mutex_lock(lock);
+        stat_entry_t *e = sc->slots[slot];
+        if (e && e->hash == hash && now < e->expires_at &&
+            e->generation == generation && strcmp(e->path, path) == 0) {
+            int status = e->status;
+            if (status == 200) {
+                atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+                *entry = e;
+            }
+            pthread_mutex_unlock(lock);
+            return status;
+        }
+        pthread_mutex_unlock(lock);
+    }
+
+    stat_entry_t *e;
+    int status = resolve(path, hash, &e);
+    if (!e) return status;
+
+    e->expires_at = now + sc->ttl_ns;
+    e->generation = generation;
+
+    stat_entry_t *old = NULL;
+    if (sc->ttl_ns) {
+        atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+        pthread_mutex_lock(lock);
+        old = sc->slots[slot];
+        sc->slots[slot] = e;
+        pthread_mutex_unlock(lock);
+    }
+    if (old) stat_cache_release(sc, old);
+
+    if (status == 200) {
+        *entry = e;
+    } else {
+        stat_cache_release(sc, e);
+    }
+    return status;
+}
+
+void stat_cache_forget(stat_cache_t *sc, stat_entry_t *entry) {
+    size_t slot = entry->hash & (STAT_CACHE_SLOTS - 1);
+    pthread_mutex_t *lock = &sc->locks[slot % STAT_CACHE_LOCKS];
+
+    int owned = 0;
+    pthread_mutex_lock(lock);
+    if (sc->slots[slot] == entry) {
+        sc->slots[slot] = NULL;
+        owned = 1;
+    }
+    pthread_mutex_unlock(lock);
+    if (owned) stat_cache_release(sc, entry);
+}
+
+int stat_entry_current(const stat_entry_t *entry) {
+    struct stat st;
+    return stat(entry->path, &st) == 0 && file_tag(&st) == entry->tag;
+}
@@ -0,0 +1,56 @@
+#ifndef STAT_CACHE_H
+#define STAT_CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include "cache.h"
+
+#define STAT_CACHE_SLOTS 256   // entradas por worker (e ficheiros abertos, no máximo)
+#define STAT_CACHE_LOCKS 16
+
+// path resolvido por um open + fstat: metadados e o fd aberto, partilhado
+// pelas threads do worker (só pread/sendfile com offset, nunca a posição do fd);
+// os campos não mudam depois de criada, basta estar fixada para os ler
+typedef struct {
+    uint64_t hash;
+    int      status;           // 200, 403 ou 500 (404 fica na cache negativa partilhada)
+    int      fd;               // -1 se status != 200
+    off_t    size;
+    struct timespec mtime;
+    ino_t    ino;
+    dev_t    dev;
+    uint64_t tag;              // versão do ficheiro: hash de inode, device, tamanho e mtime
+    char     etag[HTTP_ETAG_SIZE];  // o mesmo em ETag forte (http_etag)
+    uint64_t expires_at;       // CLOCK_MONOTONIC, ns
+    unsigned long generation;  // cache_generation quando foi resolvido
+    atomic_int refs;           // slot + pedidos que a usam
+    char     path[];
+} stat_entry_t;
+
+// cache de metadados de um worker: mapeamento direto, uma colisão substitui;
+// uma entrada vale até ao TTL ou até o watcher invalidar qualquer ficheiro
+typedef struct {
+    stat_entry_t   *slots[STAT_CACHE_SLOTS];
+    pthread_mutex_t locks[STAT_CACHE_LOCKS];
+    cache_t        *cache;     // geração das invalidações (NULL: só o TTL)
+    uint64_t        ttl_ns;    // 0: cada pedido faz o seu open + fstat
+} stat_cache_t;
+
+stat_cache_t* stat_cache_create(cache_t *cache, int ttl_ms);
+void stat_cache_destroy(stat_cache_t *sc);
+
+// resolve path: 200, 403, 404 ou 500; com 200 *entry fica fixada (fd aberto)
+// e tem de ser largada com stat_cache_release
+int stat_cache_lookup(stat_cache_t *sc, const char *path, stat_entry_t **entry);
+void stat_cache_release(stat_cache_t *sc, stat_entry_t *entry);
+
+// o ficheiro já não corresponde à entrada (leitura curta): o próximo pedido reabre
+void stat_cache_forget(stat_cache_t *sc, stat_entry_t *entry);
+
+// 1 se o path ainda é o ficheiro da entrada (um stat, compara a tag)
+int stat_entry_current(const stat_entry_t *entry);
+
+#endif
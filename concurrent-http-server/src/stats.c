@@ -17,6 +17,8 @@
 #define SEM_LOG_NAME   "/web_sem_log"
 
 shared_data_t* create_shared_memory() {
+    // objeto novo: outra instância (noutra porta) fica com o seu mapeamento
+    shm_unlink(SHM_NAME);
     int shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
     if (shm_fd == -1) {
         perror("shm_open");
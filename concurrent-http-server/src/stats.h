@@ -17,9 +17,11 @@ typedef struct {
     long total_requests;
     long bytes_transferred;
     long status_200;
+    long status_304;
     long status_400;
     long status_403;
     long status_404;
+    long status_416;
     long status_500;
     long status_501;
     long status_503;
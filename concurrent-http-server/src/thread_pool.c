@@ -5,29 +5,47 @@
 #include "http.h"
 #include "cache.h"
 #include "worker.h"
+#include "event_loop.h"
+#include "scheduler.h"
+#include "admission.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
+#include <stdatomic.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/socket.h>
+
+// resposta 503 pré-serializada; só o event loop a usa
+// (refeita uma vez por segundo por causa do header Date)
+typedef struct {
+    char   *body;       // página 503, lida uma vez
+    size_t  body_len;
+    char   *buf;        // headers + corpo prontos a enviar
+    size_t  len;
+    time_t  built_at;
+    int     retry_after;
+} overload_response_t;
+
+// 503 do event loop ainda por registar: o event loop só formata a linha e
+// soma os contadores aqui (mutex do processo, sem disco nem semáforos
+// partilhados); uma thread do pool escreve o lote entre dois pedidos
+// há sempre uma a seguir: só se rejeita com pedidos na fila
+#define SHED_LOG_MAX (1024 * 1024)
 
-// fila local com condition variables
 typedef struct {
-    int *queue;
-    int capacity;
-    int size;
-    int front;
-    int rear;
-    int stopping;
-    pthread_mutex_t mutex;
-    pthread_cond_t not_empty;
-    pthread_cond_t not_full;
-} local_queue_t;
+    pthread_mutex_t lock;
+    char       *buf;        // linhas do log por escrever
+    size_t      len;
+    size_t      cap;
+    long        requests;   // 503 por somar às estatísticas
+    long        bytes;
+    long        dropped;    // linhas perdidas com o buffer em SHED_LOG_MAX
+    atomic_int  pending;
+} shed_log_t;
 
 typedef struct {
     shared_data_t   *shared;
@@ -35,138 +53,224 @@ typedef struct {
     server_config_t *config;
     logger_t        *logger;
     cache_t         *cache;
-    int             server_fd;
-    local_queue_t   *local_queue;
+    stat_cache_t    *stat_cache;   // metadados e fds abertos deste worker
+    event_loop_t    *loop;
+    scheduler_t     *sched;
+    admission_t     *admission;
+    overload_response_t *overload;
+    shed_log_t      *shed_log;
 } thread_args_t;
 
-static void* worker_thread(void *arg);
-static void* dispatcher_thread(void *arg);
-static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t *args, int *keep_alive);
+// cada thread do pool tem a sua fila no escalonador
+typedef struct {
+    thread_args_t *args;
+    int            id;
+} worker_arg_t;
 
-static local_queue_t* create_local_queue(int capacity) {
-    local_queue_t *q = malloc(sizeof(local_queue_t));
-    if (!q) return NULL;
-    
-    q->queue = malloc(capacity * sizeof(int));
-    if (!q->queue) {
-        free(q);
-        return NULL;
+static void* worker_thread(void *arg);
+static void* event_loop_thread(void *arg);
+static void process_connection(conn_t *conn, thread_args_t *args);
+static long handle_client_request(out_queue_t *out, HttpRequest *req, thread_args_t *args, int *keep_alive);
+
+static const char *overload_response(overload_response_t *r, size_t *len) {
+    time_t now = time(NULL);
+    if (!r->buf || now != r->built_at) {
+        static const char fallback[] = "<h1>503 Service Unavailable</h1>";
+        const char *body = r->body ? r->body : fallback;
+        size_t body_len = r->body ? r->body_len : sizeof(fallback) - 1;
+
+        char extra[64];
+        snprintf(extra, sizeof(extra), "Retry-After: %d\r\n", r->retry_after);
+
+        char headers[RESPONSE_HEADERS_SIZE];
+        int header_len = build_response_headers(headers, sizeof(headers),
+                                                "HTTP/1.1 503 Service Unavailable",
+                                                "text/html; charset=utf-8",
+                                                (long)body_len, extra, "close");
+        char *buf = header_len < 0 ? NULL : realloc(r->buf, header_len + body_len);
+        if (!buf) return NULL;
+
+        memcpy(buf, headers, header_len);
+        memcpy(buf + header_len, body, body_len);
+        r->buf = buf;
+        r->len = header_len + body_len;
+        r->built_at = now;
     }
-    
-    q->capacity = capacity;
-    q->size = 0;
-    q->front = 0;
-    q->rear = 0;
-    q->stopping = 0;
-    
-    pthread_mutex_init(&q->mutex, NULL);
-    pthread_cond_init(&q->not_empty, NULL);
-    pthread_cond_init(&q->not_full, NULL);
-    
-    return q;
+    *len = r->len;
+    return r->buf;
 }
 
-static void destroy_local_queue(local_queue_t *q) {
-    if (!q) return;
-    pthread_mutex_destroy(&q->mutex);
-    pthread_cond_destroy(&q->not_empty);
-    pthread_cond_destroy(&q->not_full);
-    free(q->queue);
-    free(q);
-}
-
-static void local_queue_push(local_queue_t *q, int fd) {
-    pthread_mutex_lock(&q->mutex);
-    
-    // aguarda se fila cheia
-    while (q->size >= q->capacity && !q->stopping) {
-        pthread_cond_wait(&q->not_full, &q->mutex);
+// event loop: rejeita a conexão com 503 sem ocupar uma thread do pool
+static void shed_connection(conn_t *conn, thread_args_t *args) {
+    // a linha do pedido fica para o log: com io_uring o pedido já foi lido
+    // para in_buf, com epoll ainda está no socket
+    char scratch[BUFFER_SIZE];
+    HttpRequest req;
+    int parsed = conn->in_len > 0 && parse_http_request(conn->in_buf, &req) == 0;
+
+    // descarta o pedido por ler: fechar com dados por ler faz RST
+    // e o cliente perderia a resposta
+    for (int i = 0; i < 4; i++) {
+        ssize_t n = recv(conn->fd, scratch, sizeof(scratch) - 1, MSG_DONTWAIT);
+        if (n <= 0) break;
+        if (i == 0 && conn->in_len == 0) {
+            scratch[n] = '\0';
+            parsed = parse_http_request(scratch, &req) == 0;
+        }
     }
 
-    if (q->stopping) {
-        pthread_mutex_unlock(&q->mutex);
-        return;
+    size_t len;
+    const char *response = overload_response(args->overload, &len);
+    ssize_t sent = response ? send(conn->fd, response, len, MSG_DONTWAIT | MSG_NOSIGNAL) : -1;
+    long bytes = sent > 0 ? (long)sent : 0;
+
+    char line[1024];
+    int line_len = log_format_request(line, sizeof(line), parsed ? req.method : NULL,
+                                      parsed ? req.path : NULL, parsed ? req.version : NULL,
+                                      503, bytes);
+    shed_log_t *log = args->shed_log;
+    pthread_mutex_lock(&log->lock);
+    log->requests++;
+    log->bytes += bytes;
+    if (line_len > 0) {
+        if (log->len + (size_t)line_len > log->cap && log->cap < SHED_LOG_MAX) {
+            size_t cap = log->cap ? log->cap * 2 : 16384;
+            char *grown = realloc(log->buf, cap);
+            if (grown) {
+                log->buf = grown;
+                log->cap = cap;
+            }
+        }
+        if (log->len + (size_t)line_len <= log->cap) {
+            memcpy(log->buf + log->len, line, (size_t)line_len);
+            log->len += (size_t)line_len;
+        } else {
+            log->dropped++;
+        }
     }
-    
-    q->queue[q->rear] = fd;
-    q->rear = (q->rear + 1) % q->capacity;
-    q->size++;
-    
-    pthread_cond_signal(&q->not_empty);
-    pthread_mutex_unlock(&q->mutex);
+    atomic_store_explicit(&log->pending, 1, memory_order_release);
+    pthread_mutex_unlock(&log->lock);
+
+    event_loop_close(args->loop, conn);
 }
 
-static int local_queue_pop(local_queue_t *q) {
-    pthread_mutex_lock(&q->mutex);
-    
-    // aguarda se fila vazia
-    while (q->size == 0 && !q->stopping) {
-        pthread_cond_wait(&q->not_empty, &q->mutex);
+// thread do pool: escreve as linhas dos 503 acumuladas pelo event loop e
+// soma-as às estatísticas; o buffer troca de dono para o write ser fora do mutex
+static void flush_shed_log(thread_args_t *args) {
+    shed_log_t *log = args->shed_log;
+    if (!atomic_load_explicit(&log->pending, memory_order_acquire)) return;
+
+    pthread_mutex_lock(&log->lock);
+    char *buf = log->buf;
+    size_t len = log->len;
+    long requests = log->requests, bytes = log->bytes, dropped = log->dropped;
+    log->buf = NULL;
+    log->len = log->cap = 0;
+    log->requests = log->bytes = log->dropped = 0;
+    atomic_store_explicit(&log->pending, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&log->lock);
+
+    if (requests > 0) {
+        sem_wait(args->sems->stats);
+        args->shared->stats.total_requests += requests;
+        args->shared->stats.status_503 += requests;
+        args->shared->stats.bytes_transferred += bytes;
+        sem_post(args->sems->stats);
+    }
+    log_write_lines(args->logger, buf, len);
+    if (dropped > 0) {
+        fprintf(stderr, "[WORKER PID=%d] %ld linhas de 503 fora do log (buffer cheio)\n",
+                getpid(), dropped);
     }
+    free(buf);
+}
+
+// callback do event loop: conexão com dados prontos vai para a fila de uma thread,
+// ou é rejeitada com 503 se o worker estiver sobrecarregado
+static void on_connection_ready(conn_t *conn, void *ctx) {
+    thread_args_t *args = (thread_args_t*)ctx;
 
-    if (q->stopping && q->size == 0) {
-        pthread_mutex_unlock(&q->mutex);
-        return -1;
+    // resposta a meio: tem de ser terminada, não se rejeita
+    if (!out_queue_pending(&conn->out) &&
+        admission_reject(args->admission, scheduler_depth(args->sched))) {
+        shed_connection(conn, args);
+        return;
     }
-    
-    int fd = q->queue[q->front];
-    q->front = (q->front + 1) % q->capacity;
-    q->size--;
-    
-    pthread_cond_signal(&q->not_full);
-    pthread_mutex_unlock(&q->mutex);
-    
-    return fd;
+
+    conn->queued_at = admission_now();
+    scheduler_submit(args->sched, conn);
 }
 
 void thread_pool_start(shared_data_t *shared, 
                       semaphores_t *sems, 
                       server_config_t *config, 
                       logger_t *logger,
-                      int server_fd) 
+                      cache_t *cache,
+                      int listen_fd) 
 {
     int num_threads = config->threads_per_worker;
     if (num_threads <= 0) num_threads = 1;
 
-    cache_t *cache = malloc(sizeof(cache_t));
-    if (!cache) {
-        perror("malloc cache");
+
+    // capacidade total max_queue_size repartida pelas filas das threads
+    scheduler_t sched;
+    int per_thread = (config->max_queue_size + num_threads - 1) / num_threads;
+    if (scheduler_init(&sched, num_threads, per_thread) != 0) {
+        perror("scheduler_init");
         exit(1);
     }
-    
-    size_t max_bytes = (size_t)config->cache_size_mb * 1024 * 1024;
-    if (max_bytes == 0) max_bytes = 1 * 1024 * 1024;
-    cache_init(cache, max_bytes);
 
-    local_queue_t *local_queue = create_local_queue(config->max_queue_size);
-    if (!local_queue) {
-        perror("create_local_queue");
+    admission_t admission;
+    admission_init(&admission, config->overload_queue_depth,
+                   config->overload_target_delay_ms, config->overload_interval_ms);
+
+    shed_log_t shed_log = {0};
+    pthread_mutex_init(&shed_log.lock, NULL);
+
+    overload_response_t overload = {0};
+    overload.retry_after = config->retry_after_seconds;
+    overload.body = load_error_page("503.html", &overload.body_len);
+
+    thread_args_t args;
+    event_loop_t loop;
+    if (event_loop_init(&loop, config, listen_fd, shared, sems, on_connection_ready, &args) != 0) {
+        fprintf(stderr, "[WORKER PID=%d] Erro ao criar event loop\n", getpid());
         exit(1);
     }
 
-    thread_args_t args;
     args.shared = shared;
     args.sems = sems;
     args.config = config;
     args.logger = logger;
     args.cache = cache;
-    args.server_fd = server_fd;
-    args.local_queue = local_queue;
+    args.stat_cache = stat_cache_create(cache, config->stat_cache_ttl_ms);
+    if (!args.stat_cache) {
+        perror("stat_cache_create");
+        exit(1);
+    }
+    args.loop = &loop;
+    args.sched = &sched;
+    args.admission = &admission;
+    args.overload = &overload;
+    args.shed_log = &shed_log;
 
     pthread_t *threads = malloc((num_threads + 1) * sizeof(pthread_t));
-    if (!threads) {
+    worker_arg_t *worker_args = malloc(num_threads * sizeof(worker_arg_t));
+    if (!threads || !worker_args) {
         perror("malloc threads");
         exit(1);
     }
 
-    // dispatcher: aceita conexões e distribui para fila local
-    if (pthread_create(&threads[0], NULL, dispatcher_thread, &args) != 0) {
-        perror("pthread_create dispatcher");
+    // event loop: aceita conexões e distribui as que têm dados pelas filas das threads
+    if (pthread_create(&threads[0], NULL, event_loop_thread, &args) != 0) {
+        perror("pthread_create event loop");
         exit(1);
     }
 
     for (int i = 0; i < num_threads; i++) {
-        if (pthread_create(&threads[i+1], NULL, worker_thread, &args) != 0) {
+        worker_args[i].args = &args;
+        worker_args[i].id = i;
+        if (pthread_create(&threads[i+1], NULL, worker_thread, &worker_args[i]) != 0) {
             perror("pthread_create worker");
             exit(1);
         }
@@ -176,163 +280,231 @@ void thread_pool_start(shared_data_t *shared,
         pause();
     }
 
-    pthread_mutex_lock(&local_queue->mutex);
-    local_queue->stopping = 1;
-    pthread_cond_broadcast(&local_queue->not_empty);
-    pthread_cond_broadcast(&local_queue->not_full);
-    pthread_mutex_unlock(&local_queue->mutex);
+    scheduler_stop(&sched);
 
     pthread_join(threads[0], NULL);
     for (int i = 0; i < num_threads; i++) {
         pthread_join(threads[i+1], NULL);
     }
 
-    destroy_local_queue(local_queue);
-    cache_destroy(cache);
-    free(cache);
+    // o que o event loop rejeitou depois do último pedido servido
+    flush_shed_log(&args);
+    pthread_mutex_destroy(&shed_log.lock);
+
+    event_loop_destroy(&loop);
+    scheduler_destroy(&sched);
+    stat_cache_destroy(args.stat_cache);
+    free(overload.body);
+    free(overload.buf);
+    free(worker_args);
     free(threads);
 }
 
-static void* dispatcher_thread(void *arg) {
+static void* event_loop_thread(void *arg) {
     thread_args_t *args = (thread_args_t*)arg;
-    local_queue_t *local_queue = args->local_queue;
-    int server_fd = args->server_fd;
-    printf("[WORKER PID=%d] Dispatcher thread started, will accept on fd=%d\n", getpid(), server_fd);
-    
+
+    event_loop_run(args->loop);
+
+    scheduler_stop(args->sched);
+    return NULL;
+}
+
+static void* worker_thread(void *arg) {
+    worker_arg_t *warg = (worker_arg_t*)arg;
+    thread_args_t *args = warg->args;
+
+    // própria fila primeiro; sem trabalho rouba às outras threads antes de parar
     for (;;) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
-            if (errno == EINTR && worker_shutdown) {
-                break;
-            }
-            if (errno == EINTR) continue;
-            if (errno == EBADF || errno == EINVAL) break;
-            perror("accept failed (dispatcher)");
-            continue;
+        conn_t *conn = scheduler_next(args->sched, warg->id);
+        if (!conn) {
+            break;
         }
-        local_queue_push(local_queue, client_fd);
+
+        uint64_t now = admission_now();
+        admission_observe(args->admission, now - conn->queued_at, now);
+        process_connection(conn, args);
+        flush_shed_log(args);
     }
 
-    pthread_mutex_lock(&local_queue->mutex);
-    local_queue->stopping = 1;
-    pthread_cond_broadcast(&local_queue->not_empty);
-    pthread_cond_broadcast(&local_queue->not_full);
-    pthread_mutex_unlock(&local_queue->mutex);
     return NULL;
 }
 
-static void* worker_thread(void *arg) {
-    thread_args_t *args = (thread_args_t*)arg;
+// soma às estatísticas os bytes que chegaram de facto ao socket
+static void account_bytes_sent(conn_t *conn, thread_args_t *args) {
+    if (conn->out.bytes_sent == 0) return;
+
+    sem_wait(args->sems->stats);
+    args->shared->stats.bytes_transferred += conn->out.bytes_sent;
+    sem_post(args->sems->stats);
+    conn->out.bytes_sent = 0;
+}
+
+// resposta entregue à fila de saída: espera por espaço, pelo próximo pedido ou fecha
+static void finish_response(conn_t *conn, thread_args_t *args) {
+    account_bytes_sent(conn, args);
+
+    if (conn->out.error) {
+        event_loop_close(args->loop, conn);
+    } else if (out_queue_pending(&conn->out)) {
+        // cliente lento: a thread fica livre até o socket ter espaço
+        event_loop_wait_writable(args->loop, conn);
+    } else if (conn->keep_alive) {
+        event_loop_rearm(args->loop, conn);
+    } else {
+        event_loop_close(args->loop, conn);
+    }
+}
+
+// tamanho do pedido completo no início do buffer (0 se ainda incompleto)
+static size_t buffered_request_length(conn_t *conn) {
+    conn->in_buf[conn->in_len] = '\0';
+    char *end = strstr(conn->in_buf, "\r\n\r\n");
+    if (end) return (size_t)(end - conn->in_buf) + 4;
+
+    // buffer cheio sem fim de headers: processa o que foi lido
+    if (conn->in_len >= sizeof(conn->in_buf) - 1) return conn->in_len;
+    return 0;
+}
+
+// responde ao pedido de req_len bytes no início do buffer e descarta-o,
+// mantendo os bytes seguintes (pedidos em pipeline)
+static void process_request(conn_t *conn, size_t req_len, thread_args_t *args) {
     shared_data_t *shared = args->shared;
     semaphores_t  *sems   = args->sems;
-    local_queue_t *local_queue = args->local_queue;
 
-    for (;;) {
-        int client_fd = local_queue_pop(local_queue);
-        if (client_fd < 0) {
-            break;
-        }
-        
-        if (client_fd < 3) {
-            fprintf(stderr, "[WORKER THREAD PID=%d] Invalid fd from queue: %d\n", getpid(), client_fd);
-            continue;
-        }
+    // Keep-Alive: até KEEPALIVE_MAX_REQUESTS pedidos por conexão
+    const int max_requests = args->config->keepalive_max_requests;
+    int keep_alive = 1;
+
+    // o parser só vê este pedido
+    char next_byte = conn->in_buf[req_len];
+    conn->in_buf[req_len] = '\0';
+
+    HttpRequest req;
+    int parsed = parse_http_request(conn->in_buf, &req);
+
+    conn->in_buf[req_len] = next_byte;
+    memmove(conn->in_buf, conn->in_buf + req_len, conn->in_len - req_len);
+    conn->in_len -= req_len;
+    conn->in_buf[conn->in_len] = '\0';
+    conn->read_started = 0;
 
-        // Keep-Alive: até 50 requests por conexão
-        const int max_requests = 50;
-        int requests_count = 0;
-        int keep_alive = 1;
+    if (parsed != 0) {
+        long sent = send_error(&conn->out,
+                   "HTTP/1.1 400 Bad Request",
+                   "<h1>400 Bad Request</h1>");
         
-        // incrementa active_connections uma vez por conexão
         sem_wait(sems->stats);
-        shared->stats.active_connections++;
+        shared->stats.status_400++;
+        shared->stats.total_requests++;
         sem_post(sems->stats);
         
-        // timeout: 5s entre requests
-        struct timeval timeout;
-        timeout.tv_sec = 5;
-        timeout.tv_usec = 0;
-        if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-            if (errno != EBADF) {
-                perror("setsockopt SO_RCVTIMEO (keep-alive)");
-            }
+        log_request(args->logger, NULL, NULL, NULL, 400, sent);
+        conn->keep_alive = 0;
+        return;
+    }
+
+    // o header Connection da resposta já reflete se a conexão fica aberta
+    conn->out.keep_alive = req.keep_alive && conn->requests_count + 1 < max_requests;
+    
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    
+    sem_wait(sems->stats);
+    shared->stats.total_requests++;
+    sem_post(sems->stats);
+
+    handle_client_request(&conn->out, &req, args, &keep_alive);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    
+    double response_time = (end_time.tv_sec - start_time.tv_sec) + 
+                          (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+
+    sem_wait(sems->stats);
+    shared->stats.total_response_time += response_time;
+    shared->stats.completed_requests++;
+    sem_post(sems->stats);
+    
+    conn->requests_count++;
+    conn->keep_alive = keep_alive && conn->out.keep_alive;
+}
+
+// processa os pedidos completos de uma conexão e devolve-a ao event loop
+static void process_connection(conn_t *conn, thread_args_t *args) {
+    if (out_queue_pending(&conn->out)) {
+        // socket voltou a ter espaço: continua a resposta anterior
+        out_queue_flush(&conn->out);
+        if (out_queue_pending(&conn->out) || conn->out.error || !conn->keep_alive) {
+            finish_response(conn, args);
+            return;
         }
+        // segue para os pedidos em pipeline que ficaram no buffer
+    } else {
+        int ready = read_http_request(conn->fd, conn->in_buf, &conn->in_len, sizeof(conn->in_buf));
+        if (ready < 0) {
+            event_loop_close(args->loop, conn);
+            return;
+        }
+        // ready == 0: pedido incompleto, espera por mais dados sem ocupar a thread
+    }
 
-        while (keep_alive && requests_count < max_requests) {
-            char buffer[BUFFER_SIZE];
-            ssize_t bytes_read = read_http_request(client_fd, buffer, sizeof(buffer));
-            
-            if (bytes_read <= 0) {
-                break;
-            }
-            
-            buffer[bytes_read] = '\0';
-            
-            HttpRequest req;
-            if (parse_http_request(buffer, &req) != 0) {
-                long sent = send_error(client_fd,
-                           "HTTP/1.1 400 Bad Request",
-                           "<h1>400 Bad Request</h1>");
-                
-                sem_wait(sems->stats);
-                shared->stats.status_400++;
-                shared->stats.total_requests++;
-                shared->stats.bytes_transferred += sent;
-                sem_post(sems->stats);
-                
-                log_request(args->logger, NULL, NULL, NULL, 400, sent);
-                keep_alive = 0;
-                break;
-            }
-            
-            // HTTP/1.0 não suporta Keep-Alive
-            if (strcmp(req.version, "HTTP/1.0") == 0) {
-                keep_alive = 0;
-            }
-            
-            struct timespec start_time, end_time;
-            clock_gettime(CLOCK_MONOTONIC, &start_time);
-            
-            sem_wait(sems->stats);
-            shared->stats.total_requests++;
-            sem_post(sems->stats);
-
-            long bytes_sent = handle_client_request(client_fd, &req, args, &keep_alive);
-
-            clock_gettime(CLOCK_MONOTONIC, &end_time);
-            
-            double response_time = (end_time.tv_sec - start_time.tv_sec) + 
-                                  (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
-
-            sem_wait(sems->stats);
-            shared->stats.bytes_transferred += bytes_sent;
-            shared->stats.total_response_time += response_time;
-            shared->stats.completed_requests++;
-            sem_post(sems->stats);
-            
-            requests_count++;
+    // pipelining: responde por ordem a todos os pedidos já recebidos;
+    // as respostas pequenas saem juntas no uncork
+    for (;;) {
+        out_queue_cork(&conn->out);
+        size_t req_len;
+        while (conn->keep_alive && !conn->out.error &&
+               conn->out.queued <= OUT_CORK_MAX &&
+               (req_len = buffered_request_length(conn)) > 0) {
+            process_request(conn, req_len, args);
+        }
+        out_queue_uncork(&conn->out);
+
+        if (out_queue_pending(&conn->out) || conn->out.error || !conn->keep_alive ||
+            buffered_request_length(conn) == 0) {
+            break;
         }
-        
-        close(client_fd);
-        
-        sem_wait(sems->stats);
-        shared->stats.active_connections--;
-        sem_post(sems->stats);
     }
 
-    return NULL;
+    finish_response(conn, args);
 }
 
-static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t *args, int *keep_alive) {
+// resolve o path: a cache negativa responde 404 sem tocar no disco; senão a
+// stat_cache (no máximo um open + fstat) e um 404 novo fica na cache negativa
+// (o watcher tira-o se o ficheiro for criado)
+static int resolve_file(thread_args_t *args, const char *fullpath, stat_entry_t **file) {
+    *file = NULL;
+    if (args->cache && cache_is_negative(args->cache, fullpath)) return 404;
+
+    int status = stat_cache_lookup(args->stat_cache, fullpath, file);
+    if (status == 404 && args->cache) {
+        cache_put_negative(args->cache, fullpath, args->config->negative_cache_ttl);
+    }
+    return status;
+}
+
+static void count_status(thread_args_t *args, int status) {
+    sem_wait(args->sems->stats);
+    switch (status) {
+        case 304: args->shared->stats.status_304++; break;
+        case 403: args->shared->stats.status_403++; break;
+        case 404: args->shared->stats.status_404++; break;
+        case 416: args->shared->stats.status_416++; break;
+        case 500: args->shared->stats.status_500++; break;
+        default:  args->shared->stats.status_200++; break;  // ou criar stats.status_206
+    }
+    sem_post(args->sems->stats);
+}
+
+static long handle_client_request(out_queue_t *out, HttpRequest *req, thread_args_t *args, int *keep_alive) {
     // previne  "../"
     if (strstr(req->path, "..") != NULL) {
         sem_wait(args->sems->stats);
         args->shared->stats.status_403++;
         sem_post(args->sems->stats);
         
-        long sent = send_error(client_fd,
+        long sent = send_error(out,
                    "HTTP/1.1 403 Forbidden",
                    "<h1>403 Forbidden</h1>");
         
@@ -348,7 +520,7 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
         args->shared->stats.status_400++;
         sem_post(args->sems->stats);
         
-        long sent = send_error(client_fd,
+        long sent = send_error(out,
                    "HTTP/1.1 400 Bad Request",
                    "<h1>400 Bad Request</h1><p>This error was intentionally triggered for testing.</p>");
         
@@ -363,7 +535,7 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
         args->shared->stats.status_501++;
         sem_post(args->sems->stats);
         
-        long sent = send_error(client_fd,
+        long sent = send_error(out,
                    "HTTP/1.1 501 Not Implemented",
                    "<h1>501 Not Implemented</h1><p>This error was intentionally triggered for testing.</p>");
         
@@ -392,28 +564,34 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
             "  \"total_bytes\": %ld,\n"
             "  \"requests_by_status\": {\n"
             "    \"200\": %ld,\n"
+            "    \"304\": %ld,\n"
             "    \"400\": %ld,\n"
             "    \"403\": %ld,\n"
             "    \"404\": %ld,\n"
+            "    \"416\": %ld,\n"
             "    \"500\": %ld,\n"
             "    \"501\": %ld,\n"
             "    \"503\": %ld\n"
             "  },\n"
             "  \"active_connections\": %d,\n"
             "  \"avg_response_time_ms\": %.2f,\n"
+            "  \"cache_disk_reads\": %lu,\n"
             "  \"uptime_seconds\": %ld\n"
             "}",
             args->shared->stats.total_requests,
             args->shared->stats.bytes_transferred,
             args->shared->stats.status_200,
+            args->shared->stats.status_304,
             args->shared->stats.status_400,
             args->shared->stats.status_403,
             args->shared->stats.status_404,
+            args->shared->stats.status_416,
             args->shared->stats.status_500,
             args->shared->stats.status_501,
             args->shared->stats.status_503,
             args->shared->stats.active_connections,
             avg_response_time_ms,
+            args->cache ? atomic_load_explicit(&args->cache->disk_reads, memory_order_relaxed) : 0UL,
             uptime_seconds
         );
         
@@ -422,7 +600,7 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
         sem_post(args->sems->stats);
         
         int send_body = (strcmp(req->method, "GET") == 0);
-        long sent = send_json_response(client_fd, json_body, send_body);
+        long sent = send_json_response(out, json_body, send_body);
         
         log_request(args->logger, req->method, req->path, req->version, 200, sent);
         return sent;
@@ -439,7 +617,7 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
         sem_post(args->sems->stats);
         
         int send_body = (strcmp(req->method, "GET") == 0);
-        long sent = send_html_response(client_fd, html_body, send_body);
+        long sent = send_html_response(out, html_body, send_body);
         
         log_request(args->logger, req->method, req->path, req->version, 200, sent);
         return sent;
@@ -451,7 +629,7 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
         args->shared->stats.status_500++;
         sem_post(args->sems->stats);
         
-        long sent = send_error(client_fd,
+        long sent = send_error(out,
                    "HTTP/1.1 500 Internal Server Error",
                    "<h1>500 Internal Server Error</h1><p>This error was intentionally triggered for testing.</p>");
         
@@ -465,7 +643,7 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
         args->shared->stats.status_501++;
         sem_post(args->sems->stats);
         
-        long sent = send_error(client_fd,
+        long sent = send_error(out,
                    "HTTP/1.1 501 Not Implemented",
                    "<h1>501 Not Implemented</h1>");
         
@@ -479,65 +657,49 @@ static long handle_client_request(int client_fd, HttpRequest *req, thread_args_t
     const char* vroot = resolve_vhost_root(req->hostname, args->config);
     
     char fullpath[1024];
-    if (strcmp(req->path, "/") == 0) {
-        snprintf(fullpath, sizeof(fullpath), "%s/index.html", vroot);
-    } else {
-        snprintf(fullpath, sizeof(fullpath), "%s%s", vroot, req->path);
-        
-        size_t len = strlen(fullpath);
-        if (len > 0 && fullpath[len - 1] == '/') {
-            if (len + 10 < sizeof(fullpath)) {
-                strncat(fullpath, "index.html", sizeof(fullpath) - len - 1);
-            }
-        }
-    }
+    build_fullpath(fullpath, sizeof(fullpath), vroot, req->path);
 
     int send_body = strcmp(req->method, "HEAD") != 0;
     
     long sent;
+    int status;
     
-    // Range Request: envia apenas parte do ficheiro
-    if (req->has_range) {
-        if (access(fullpath, F_OK) != 0) {
-            sem_wait(args->sems->stats);
-            args->shared->stats.status_404++;
-            sem_post(args->sems->stats);
-            sent = send_error(client_fd, "HTTP/1.1 404 Not Found", "<h1>404 Not Found</h1>");
-            log_request(args->logger, req->method, req->path, req->version, 404, sent);
-        } else if (access(fullpath, R_OK) != 0) {
-            sem_wait(args->sems->stats);
-            args->shared->stats.status_403++;
-            sem_post(args->sems->stats);
-            sent = send_error(client_fd, "HTTP/1.1 403 Forbidden", "<h1>403 Forbidden</h1>");
-            log_request(args->logger, req->method, req->path, req->version, 403, sent);
-        } else {
-            sem_wait(args->sems->stats);
-            args->shared->stats.status_200++;  // ou criar stats.status_206
-            sem_post(args->sems->stats);
-            sent = send_file_range(client_fd, fullpath, send_body, req->range_start, req->range_end);
-            log_request(args->logger, req->method, req->path, req->version, 206, sent);
-        }
+    // hit na cache de conteúdo: nenhuma syscall sobre o ficheiro (o watcher tira
+    // da cache o que muda no disco, permissões incluídas); um Range sai da mesma entrada
+    if (args->cache &&
+        (sent = req->has_range
+                ? send_cached_range(out, fullpath, send_body, args->cache, req->if_none_match,
+                                    req->range_start, req->range_end, &status)
+                : send_cached_file(out, fullpath, send_body, args->cache, req->if_none_match,
+                                   &status)) >= 0) {
+        // status já vem da resposta (200, 206, 304 ou 416)
     } else {
-        if (access(fullpath, F_OK) != 0) {
-            sem_wait(args->sems->stats);
-            args->shared->stats.status_404++;
-            sem_post(args->sems->stats);
-            sent = send_file_with_cache(client_fd, fullpath, send_body, args->cache);
-            log_request(args->logger, req->method, req->path, req->version, 404, sent);
-        } else if (access(fullpath, R_OK) != 0) {
-            sem_wait(args->sems->stats);
-            args->shared->stats.status_403++;
-            sem_post(args->sems->stats);
-            sent = send_file_with_cache(client_fd, fullpath, send_body, args->cache);
-            log_request(args->logger, req->method, req->path, req->version, 403, sent);
+        stat_entry_t *file;
+        status = resolve_file(args, fullpath, &file);
+        if (status == 200 && etag_matches(req->if_none_match, file->etag, strlen(file->etag))) {
+            // o cliente já tem esta versão: 304 só com os metadados, sem ler o ficheiro
+            sent = send_not_modified(out, file->etag, strlen(file->etag));
+            stat_cache_release(args->stat_cache, file);
+            status = 304;
+        } else if (status == 404) {
+            sent = send_error(out, "HTTP/1.1 404 Not Found", "<h1>404 Not Found</h1>");
+        } else if (status == 403) {
+            sent = send_error(out, "HTTP/1.1 403 Forbidden", "<h1>403 Forbidden</h1>");
+        } else if (status != 200) {
+            sent = send_error(out, "HTTP/1.1 500 Internal Server Error",
+                              "<h1>500 Internal Server Error</h1>");
+        } else if (req->has_range) {
+            // Range Request: envia apenas parte do ficheiro
+            sent = send_file_range(out, fullpath, send_body, args->cache, args->stat_cache, file,
+                                   req->range_start, req->range_end, &status);
         } else {
-            sem_wait(args->sems->stats);
-            args->shared->stats.status_200++;
-            sem_post(args->sems->stats);
-            sent = send_file_with_cache(client_fd, fullpath, send_body, args->cache);
-            log_request(args->logger, req->method, req->path, req->version, 200, sent);
+            sent = send_file_with_cache(out, fullpath, send_body, args->cache,
+                                        args->stat_cache, file);
         }
     }
+
+    count_status(args, status);
+    log_request(args->logger, req->method, req->path, req->version, status, sent);
     
     return sent;
 }
@@ -4,11 +4,13 @@
 #include "stats.h"
 #include "config.h"
 #include "logger.h"
+#include "cache.h"
 
 void thread_pool_start(shared_data_t *shared, 
                       semaphores_t *sems, 
                       server_config_t *config, 
                       logger_t *logger,
-                      int server_fd);
+                      cache_t *cache,
+                      int listen_fd);
 
 #endif
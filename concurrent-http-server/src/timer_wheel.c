@@ -0,0 +1,117 @@
+#include "timer_wheel.h"
+
+#include <time.h>
+
+static void list_init(timer_node_t *head) {
+    head->prev = head;
+    head->next = head;
+}
+
+static void list_append(timer_node_t *head, timer_node_t *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void timer_wheel_init(timer_wheel_t *tw, uint64_t now) {
+    tw->next_tick = now;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        for (int s = 0; s < TIMER_WHEEL_SLOTS; s++) {
+            list_init(&tw->slots[l][s]);
+        }
+    }
+}
+
+void timer_node_init(timer_node_t *node) {
+    node->prev = NULL;
+    node->next = NULL;
+    node->expires = 0;
+}
+
+void timer_wheel_del(timer_node_t *node) {
+    if (!timer_node_armed(node)) return;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+// escolhe nível e slot pela distância ao tick atual
+static void place(timer_wheel_t *tw, timer_node_t *node) {
+    uint64_t expires = node->expires;
+    if (expires < tw->next_tick) expires = tw->next_tick;
+
+    uint64_t delta = expires - tw->next_tick;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    // além do horizonte: fica no último slot alcançável
+    uint64_t horizon = 1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    if (delta >= horizon) {
+        expires = tw->next_tick + horizon - 1;
+        node->expires = expires;
+    }
+
+    int slot = (int)((expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    list_append(&tw->slots[level][slot], node);
+}
+
+void timer_wheel_add(timer_wheel_t *tw, timer_node_t *node, uint64_t expires) {
+    timer_wheel_del(node);
+    node->expires = expires;
+    place(tw, node);
+}
+
+// redistribui um slot de nível superior pelos níveis inferiores
+static int cascade(timer_wheel_t *tw, int level) {
+    int slot = (int)((tw->next_tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    timer_node_t *head = &tw->slots[level][slot];
+
+    timer_node_t work;
+    list_init(&work);
+    if (head->next != head) {
+        work.next = head->next;
+        work.prev = head->prev;
+        work.next->prev = &work;
+        work.prev->next = &work;
+        list_init(head);
+    }
+
+    while (work.next != &work) {
+        timer_node_t *node = work.next;
+        timer_wheel_del(node);
+        place(tw, node);
+    }
+    return slot;
+}
+
+void timer_wheel_advance(timer_wheel_t *tw, uint64_t now, timer_expired_cb cb, void *ctx) {
+    while (tw->next_tick <= now) {
+        int index = (int)(tw->next_tick & TIMER_WHEEL_MASK);
+
+        // o nível 0 deu a volta: desce o slot seguinte dos níveis superiores
+        for (int level = 1; index == 0 && level < TIMER_WHEEL_LEVELS; level++) {
+            if (cascade(tw, level) != 0) break;
+        }
+
+        timer_node_t *head = &tw->slots[0][index];
+        tw->next_tick++;
+
+        // cb pode cancelar outros nós: retira um de cada vez
+        while (head->next != head) {
+            timer_node_t *node = head->next;
+            timer_wheel_del(node);
+            cb(node, ctx);
+        }
+    }
+}
+
+uint64_t timer_wheel_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec;
+}
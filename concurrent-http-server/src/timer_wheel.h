@@ -0,0 +1,49 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// timer wheel hierárquico: 3 níveis de 64 slots, tick de 1 segundo
+// (horizonte de ~73 h; prazos mais longos são encurtados)
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 3
+
+// nó intrusivo (embebido na estrutura que tem o prazo)
+typedef struct timer_node {
+    struct timer_node *prev;
+    struct timer_node *next;
+    uint64_t expires;          // tick absoluto do prazo
+} timer_node_t;
+
+typedef struct {
+    uint64_t     next_tick;    // próximo tick a processar
+    timer_node_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // sentinelas
+} timer_wheel_t;
+
+typedef void (*timer_expired_cb)(timer_node_t *node, void *ctx);
+
+void timer_wheel_init(timer_wheel_t *tw, uint64_t now);
+
+void timer_node_init(timer_node_t *node);
+
+static inline int timer_node_armed(const timer_node_t *node) {
+    return node->next != NULL;
+}
+
+// (re)agenda o nó para o tick expires; O(1)
+void timer_wheel_add(timer_wheel_t *tw, timer_node_t *node, uint64_t expires);
+
+// cancela o nó se estiver agendado; O(1)
+void timer_wheel_del(timer_node_t *node);
+
+// processa os ticks até now (inclusive), chamando cb para cada prazo expirado
+// o nó já está desagendado quando cb é chamado
+void timer_wheel_advance(timer_wheel_t *tw, uint64_t now, timer_expired_cb cb, void *ctx);
+
+// segundos monotónicos (base dos ticks)
+uint64_t timer_wheel_now(void);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+// wrapper mínimo sobre as syscalls io_uring (sem liburing)
+typedef struct {
+    int ring_fd;
+    unsigned features;
+
+    // submission queue
+    void     *sq_ptr;
+    size_t    sq_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned  sq_entries;
+    unsigned  sqe_tail;       // SQEs preparadas localmente
+    unsigned  sqe_submitted;  // SQEs já publicadas ao kernel
+    struct io_uring_sqe *sqes;
+    size_t    sqes_size;
+
+    // completion queue
+    void     *cq_ptr;
+    size_t    cq_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring_t;
+
+int uring_init(uring_t *ring, unsigned entries, unsigned cq_entries);
+void uring_exit(uring_t *ring);
+
+// devolve um SQE limpo ou NULL se a SQ estiver cheia
+struct io_uring_sqe* uring_get_sqe(uring_t *ring);
+
+// publica e submete os SQEs preparados numa só syscall
+int uring_submit(uring_t *ring);
+
+// espera por pelo menos um CQE (timeout em ms); 0 em timeout
+int uring_wait(uring_t *ring, int timeout_ms);
+
+// CQE seguinte ou NULL; uring_cqe_seen liberta-o
+struct io_uring_cqe* uring_peek_cqe(uring_t *ring);
+void uring_cqe_seen(uring_t *ring);
+
+#endif
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include "warmup.h"
+#include "http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define WARMUP_MAX_DEPTH 32    // symlinks em ciclo não fazem a recursão rodar para sempre
+
+typedef struct {
+    char  *path;      // ficheiro no disco (raiz do vhost + path do pedido)
+    size_t size;
+    long   hits;      // pedidos no log (0 com "roots")
+} warm_file_t;
+
+typedef struct {
+    warm_file_t *files;
+    size_t       count;
+    size_t       cap;
+} warm_list_t;
+
+typedef struct {
+    cache_t      *cache;
+    warm_list_t  *list;
+    atomic_size_t next;
+    atomic_size_t files;
+    atomic_size_t bytes;
+} warm_job_t;
+
+static int list_add(warm_list_t *l, const char *path, size_t size, long hits) {
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        warm_file_t *files = realloc(l->files, cap * sizeof(warm_file_t));
+        if (!files) return -1;
+        l->files = files;
+        l->cap = cap;
+    }
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    l->files[l->count++] = (warm_file_t){ copy, size, hits };
+    return 0;
+}
+
+static void list_free(warm_list_t *l) {
+    for (size_t i = 0; i < l->count; i++) {
+        free(l->files[i].path);
+    }
+    free(l->files);
+}
+
+// só o que a cache aceita guardar
+static int cacheable(const struct stat *st) {
+    return S_ISREG(st->st_mode) && st->st_size > 0 && st->st_size < CACHE_MAX_FILE_SIZE;
+}
+
+static void walk_root(warm_list_t *l, const char *dir_path, int depth) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) return;
+
+    struct dirent *de;
+    char path[1024];
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir_path, de->d_name) >= (int)sizeof(path)) continue;
+
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        if (cacheable(&st)) {
+            list_add(l, path, (size_t)st.st_size, 0);
+        } else if (S_ISDIR(st.st_mode) && depth < WARMUP_MAX_DEPTH) {
+            walk_root(l, path, depth + 1);
+        }
+    }
+    closedir(dir);
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int compare_hits(const void *a, const void *b) {
+    const warm_file_t *fa = a, *fb = b;
+    return (fb->hits > fa->hits) - (fb->hits < fa->hits);
+}
+
+// paths com resposta 200 no log anterior, contados e resolvidos em cada raiz
+// (o log não guarda o vhost do pedido)
+static void collect_from_log(warm_list_t *l, const char *log_file,
+                             const char **roots, int num_roots) {
+    FILE *fp = fopen(log_file, "r");
+    if (!fp) return;
+
+    char **paths = NULL;
+    size_t count = 0, cap = 0;
+    char line[1024], method[16], path[512];
+    int status;
+
+    // - - - [data] "GET /path HTTP/1.1" 200 1234 "-" "-"
+    while (fgets(line, sizeof(line), fp)) {
+        const char *request = strchr(line, '"');
+        if (!request) continue;
+        if (sscanf(request, "\"%15s %511s %*[^\"]\" %d", method, path, &status) != 3) continue;
+        if (status != 200 || (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0)) continue;
+
+        if (count == cap) {
+            size_t new_cap = cap ? cap * 2 : 1024;
+            char **grown = realloc(paths, new_cap * sizeof(char*));
+            if (!grown) break;
+            paths = grown;
+            cap = new_cap;
+        }
+        if (!(paths[count] = strdup(path))) break;
+        count++;
+    }
+    fclose(fp);
+
+    // iguais ficam seguidos: cada sequência é um path e o seu número de pedidos
+    qsort(paths, count, sizeof(char*), compare_strings);
+    char fullpath[1024];
+    for (size_t i = 0; i < count; ) {
+        size_t j = i;
+        while (j < count && strcmp(paths[j], paths[i]) == 0) j++;
+
+        for (int r = 0; r < num_roots; r++) {
+            struct stat st;
+            build_fullpath(fullpath, sizeof(fullpath), roots[r], paths[i]);
+            if (stat(fullpath, &st) == 0 && cacheable(&st)) {
+                list_add(l, fullpath, (size_t)st.st_size, (long)(j - i));
+            }
+        }
+        i = j;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+
+    qsort(l->files, l->count, sizeof(warm_file_t), compare_hits);
+}
+
+static void* warm_thread(void *arg) {
+    warm_job_t *job = arg;
+    size_t i;
+
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->list->count) {
+        const warm_file_t *f = &job->list->files[i];
+
+        int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+
+        // o ETag é o da versão aberta, não a do stat da recolha
+        struct stat st;
+        char etag[HTTP_ETAG_SIZE];
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size != f->size) {
+            close(fd);
+            continue;
+        }
+        http_etag(etag, sizeof(etag), &st);
+
+        char *data = malloc(f->size);
+        if (data && read_at(fd, data, f->size, 0) == (ssize_t)f->size &&
+            cache_put_file(job->cache, f->path, data, f->size, etag) == 0) {
+            atomic_fetch_add(&job->files, 1);
+            atomic_fetch_add(&job->bytes, f->size);
+        }
+        free(data);
+        close(fd);
+    }
+    return NULL;
+}
+
+int cache_warmup(cache_t *cache, server_config_t *config, warmup_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    if (config->cache_warmup == CACHE_WARMUP_OFF) return -1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // DOCUMENT_ROOT e as raízes dos vhosts, sem repetidas
+    const char *roots[MAX_VHOSTS + 1];
+    int num_roots = 0;
+    roots[num_roots++] = config->document_root;
+    for (int i = 0; i < config->num_vhosts; i++) {
+        int seen = 0;
+        for (int r = 0; r < num_roots; r++) {
+            if (strcmp(roots[r], config->vhosts[i].document_root) == 0) seen = 1;
+        }
+        if (!seen) roots[num_roots++] = config->vhosts[i].document_root;
+    }
+
+    warm_list_t list = {0};
+    if (config->cache_warmup == CACHE_WARMUP_LOG) {
+        collect_from_log(&list, config->log_file, roots, num_roots);
+    } else {
+        for (int r = 0; r < num_roots; r++) {
+            walk_root(&list, roots[r], 0);
+        }
+    }
+
+    // dentro do orçamento da cache: o resto só faria despejar o que já entrou
+    // (com "log" os mais pedidos vêm primeiro)
+    size_t budget = cache->max_bytes, used = 0, kept = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        size_t charge = list.files[i].size + CACHE_MIN_CHARGE;
+        if (used + charge > budget) {
+            free(list.files[i].path);
+            continue;
+        }
+        used += charge;
+        list.files[kept++] = list.files[i];
+    }
+    list.count = kept;
+
+    warm_job_t job;
+    job.cache = cache;
+    job.list = &list;
+    atomic_init(&job.next, 0);
+    atomic_init(&job.files, 0);
+    atomic_init(&job.bytes, 0);
+
+    // leituras em paralelo: com o page cache frio o disco atende vários pedidos
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = ncpus > 0 ? (int)ncpus * 2 : 2;
+    if (num_threads > WARMUP_MAX_THREADS) num_threads = WARMUP_MAX_THREADS;
+    if ((size_t)num_threads > list.count) num_threads = (int)list.count;
+
+    pthread_t threads[WARMUP_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[started], NULL, warm_thread, &job) == 0) started++;
+    }
+    if (started == 0) warm_thread(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    list_free(&list);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->files = atomic_load(&job.files);
+    result->bytes = atomic_load(&job.bytes);
+    result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return 0;
+}
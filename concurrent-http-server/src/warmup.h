@@ -0,0 +1,22 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <stddef.h>
+#include "cache.h"
+#include "config.h"
+
+#define WARMUP_MAX_THREADS 16
+
+typedef struct {
+    size_t files;    // ficheiros carregados
+    size_t bytes;    // corpos carregados
+    double seconds;
+} warmup_result_t;
+
+// enche a cache antes de os workers aceitarem conexões (CACHE_WARMUP):
+// com "roots" percorre as raízes dos vhosts, com "log" carrega primeiro os
+// paths mais pedidos no LOG_FILE anterior; nunca passa de CACHE_SIZE_MB
+// e lê os ficheiros em paralelo; -1 se não há nada a fazer
+int cache_warmup(cache_t *cache, server_config_t *config, warmup_result_t *result);
+
+#endif
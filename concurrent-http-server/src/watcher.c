@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+#include "watcher.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define WATCH_MAX_DEPTH 32     // symlinks em ciclo não fazem a recursão rodar para sempre
+
+// associa o watch descriptor ao path do diretório (substitui o anterior:
+// um diretório movido dentro da árvore mantém o wd e muda de path)
+static void set_dir(watcher_t *w, int wd, const char *path) {
+    if (wd >= w->num_dirs) {
+        int n = w->num_dirs ? w->num_dirs : 64;
+        while (n <= wd) n *= 2;
+        char **dirs = realloc(w->dirs, n * sizeof(char*));
+        if (!dirs) return;
+        memset(dirs + w->num_dirs, 0, (n - w->num_dirs) * sizeof(char*));
+        w->dirs = dirs;
+        w->num_dirs = n;
+    }
+    free(w->dirs[wd]);
+    w->dirs[wd] = strdup(path);
+}
+
+static void watch_tree(watcher_t *w, const char *path, int depth) {
+    int wd = inotify_add_watch(w->fd, path, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "[WATCHER] Limite de watches do inotify atingido em %s "
+                            "(fs.inotify.max_user_watches)\n", path);
+        }
+        return;
+    }
+    set_dir(w, wd, path);
+
+    if (depth >= WATCH_MAX_DEPTH) return;
+
+    DIR *dir = opendir(path);
+    if (!dir) return;
+
+    struct dirent *de;
+    char sub[CACHE_MAX_KEY];
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name) >= (int)sizeof(sub)) continue;
+
+        int is_dir = de->d_type == DT_DIR;
+        if (de->d_type == DT_UNKNOWN || de->d_type == DT_LNK) {
+            struct stat st;
+            is_dir = stat(sub, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (is_dir) watch_tree(w, sub, depth + 1);
+    }
+    closedir(dir);
+}
+
+static void handle_event(watcher_t *w, const struct inotify_event *ev) {
+    // eventos perdidos: já não se sabe o que mudou
+    if (ev->mask & IN_Q_OVERFLOW) {
+        cache_invalidate_prefix(w->cache, "");
+        return;
+    }
+
+    if (ev->wd < 0 || ev->wd >= w->num_dirs || !w->dirs[ev->wd]) return;
+    const char *dir = w->dirs[ev->wd];
+
+    if (ev->mask & IN_IGNORED) {
+        free(w->dirs[ev->wd]);
+        w->dirs[ev->wd] = NULL;
+        return;
+    }
+
+    // o próprio diretório foi apagado ou movido
+    if (ev->len == 0 || (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))) {
+        cache_invalidate_prefix(w->cache, dir);
+        return;
+    }
+
+    char path[CACHE_MAX_KEY];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, ev->name) >= (int)sizeof(path)) return;
+
+    if (ev->mask & IN_ISDIR) {
+        // subárvore nova, apagada ou trocada (deploy com mv): tudo o que estava abaixo sai
+        cache_invalidate_prefix(w->cache, path);
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            watch_tree(w, path, 0);
+        }
+    } else {
+        cache_invalidate(w->cache, path);
+    }
+}
+
+static void* watcher_thread(void *arg) {
+    watcher_t *w = arg;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (!atomic_load(&w->stopping)) {
+        struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+        int n = poll(&pfd, 1, 1000);
+        if (n <= 0) continue;
+
+        ssize_t len = read(w->fd, buf, sizeof(buf));
+        if (len <= 0) continue;
+
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            handle_event(w, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return NULL;
+}
+
+int watcher_init(watcher_t *w, server_config_t *config, cache_t *cache) {
+    memset(w, 0, sizeof(*w));
+    w->cache = cache;
+    atomic_init(&w->stopping, 0);
+
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+
+    watch_tree(w, config->document_root, 0);
+    for (int i = 0; i < config->num_vhosts; i++) {
+        watch_tree(w, config->vhosts[i].document_root, 0);
+    }
+    return 0;
+}
+
+int watcher_start(watcher_t *w) {
+    if (w->fd < 0) return -1;
+
+    // os sinais (SIGINT/SIGTERM/SIGCHLD) ficam para a thread principal do master
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&w->thread, NULL, watcher_thread, w);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        fprintf(stderr, "[WATCHER] pthread_create falhou\n");
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void watcher_stop(watcher_t *w) {
+    if (w->fd < 0) return;
+
+    atomic_store(&w->stopping, 1);
+    pthread_join(w->thread, NULL);
+    close(w->fd);
+    w->fd = -1;
+
+    for (int i = 0; i < w->num_dirs; i++) {
+        free(w->dirs[i]);
+    }
+    free(w->dirs);
+    w->dirs = NULL;
+    w->num_dirs = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cache.h"
+#include "config.h"
+
+// invalidação da cache por alterações no disco: uma thread no master segue
+// com inotify as árvores de todos os vhosts e tira da cache partilhada os
+// ficheiros escritos, apagados, movidos ou com permissões alteradas
+typedef struct {
+    int         fd;            // inotify
+    cache_t    *cache;
+    char      **dirs;          // watch descriptor → diretório (NULL: livre)
+    int         num_dirs;      // tamanho de dirs
+    pthread_t   thread;
+    atomic_int  stopping;
+} watcher_t;
+
+// segue as raízes de todos os vhosts (e DOCUMENT_ROOT); -1 se o inotify falhar
+// os eventos ficam em fila no kernel até watcher_start (ex: durante o warm-up)
+int watcher_init(watcher_t *w, server_config_t *config, cache_t *cache);
+// thread que lê os eventos; depois dos forks (-1 se watcher_init falhou)
+int watcher_start(watcher_t *w);
+void watcher_stop(watcher_t *w);
+
+#endif
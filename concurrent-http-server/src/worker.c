@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
@@ -5,11 +6,13 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <sched.h>
 
 #include "worker.h"
 #include "stats.h"
 #include "logger.h"
 #include "thread_pool.h"
+#include "http.h"
 
 volatile sig_atomic_t worker_shutdown = 0;
 
@@ -18,7 +21,38 @@ static void worker_shutdown_handler(int sig) {
     worker_shutdown = 1;
 }
 
-void worker_loop(shared_data_t *shared, semaphores_t *sems, server_config_t *config, int server_fd) {
+// fixa o processo worker num CPU; as threads criadas depois herdam a afinidade
+static void pin_worker_cpu(server_config_t *config, int worker_id) {
+    if (config->cpu_affinity == CPU_AFFINITY_OFF) return;
+
+    int cpu;
+    if (config->cpu_affinity == CPU_AFFINITY_LIST) {
+        cpu = config->cpu_list[worker_id % config->num_affinity_cpus];
+    } else {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpus <= 0) ncpus = 1;
+        cpu = worker_id % (int)ncpus;
+    }
+
+    if (cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "[WORKER PID=%d] CPU %d inválido para afinidade\n", getpid(), cpu);
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+        return;
+    }
+
+    printf("[WORKER PID=%d] Pinned to CPU %d\n", getpid(), cpu);
+    fflush(stdout);
+}
+
+void worker_loop(shared_data_t *shared, semaphores_t *sems, server_config_t *config,
+                 cache_t *cache, int listen_fd, int worker_id) {
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = worker_shutdown_handler;
@@ -28,6 +62,8 @@ void worker_loop(shared_data_t *shared, semaphores_t *sems, server_config_t *con
     if (sigaction(SIGTERM, &sa, NULL) == -1) {
         perror("sigaction SIGTERM (worker)");
     }
+    pin_worker_cpu(config, worker_id);
+
     printf("[WORKER PID=%d] Reabrindo semáforos...\n", getpid());
     fflush(stdout);
     
@@ -50,8 +86,11 @@ void worker_loop(shared_data_t *shared, semaphores_t *sems, server_config_t *con
     printf("[WORKER PID=%d] Worker process started with %d threads\n", getpid(), config->threads_per_worker);
     fflush(stdout);
 
+    // páginas de erro servidas da cache partilhada em vez de relidas do disco
+    http_set_error_page_cache(cache);
+
     // inicia pool de threads (não retorna)
-    thread_pool_start(shared, sems, config, logger, server_fd);
+    thread_pool_start(shared, sems, config, logger, cache, listen_fd);
 
     destroy_logger(logger);
 }
\ No newline at end of file
@@ -3,10 +3,12 @@
 
 #include "config.h"
 #include "stats.h"
+#include "cache.h"
 #include <signal.h>
 
 extern volatile sig_atomic_t worker_shutdown;
 
-void worker_loop(shared_data_t *shared, semaphores_t *sems, server_config_t *config, int server_fd);
+void worker_loop(shared_data_t *shared, semaphores_t *sems, server_config_t *config,
+                 cache_t *cache, int listen_fd, int worker_id);
 
 #endif
@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "cache.h"
+
+// microbenchmark: N threads a ler ficheiros da cache (hits), como os workers
+// compara um só shard (equivalente ao rwlock global) com a cache dividida em shards
+// e mede a taxa de hits de LRU e W-TinyLFU com tráfego que inclui varrimentos
+// e o aproveitamento da memória com ficheiros de tamanhos muito diferentes
+
+#define CACHE_BYTES (64 * 1024 * 1024)
+#define NUM_FILES   4096
+#define FILE_SIZE   2048
+
+#define HIT_CACHE_BYTES (4 * 1024 * 1024)
+#define HOT_FILES       2000   // populares, com skew: poucos muito pedidos
+#define SCAN_PERCENT    50     // pedidos de um crawler, cada ficheiro uma só vez
+
+#define CHURN_CACHE_BYTES (16 * 1024 * 1024)
+#define CHURN_FILES       20000
+
+typedef struct {
+    cache_t     *cache;
+    unsigned     seed;
+    long         ops;
+    atomic_long *hits;
+} reader_args_t;
+
+static void* reader(void *arg) {
+    reader_args_t *r = arg;
+    unsigned seed = r->seed;
+    long hits = 0;
+    char path[64];
+    prebuilt_response_t resp;
+
+    for (long i = 0; i < r->ops; i++) {
+        snprintf(path, sizeof(path), "./www/f%d.html", rand_r(&seed) % NUM_FILES);
+        cache_entry_t *e = cache_get(r->cache, path, &resp);
+        if (e) {
+            hits++;
+            cache_release(r->cache, e);
+        }
+    }
+
+    atomic_fetch_add_explicit(r->hits, hits, memory_order_relaxed);
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static prebuilt_response_t file_response(void) {
+    static char body[FILE_SIZE];
+    static char headers[RESPONSE_HEADERS_SIZE];
+    memset(body, 'x', sizeof(body));
+
+    size_t date_off, etag_off = 0;
+    int headers_len = build_prebuilt_headers(headers, sizeof(headers), "HTTP/1.1 200 OK",
+                                             "text/html", FILE_SIZE, NULL, &date_off, &etag_off);
+    prebuilt_response_t resp = { headers, (size_t)headers_len, date_off, 0, 0, body, FILE_SIZE };
+    return resp;
+}
+
+static cache_t* fill_cache(unsigned num_shards) {
+    cache_t *cache = cache_create(CACHE_BYTES, num_shards, CACHE_POLICY_LRU, 0);
+    if (!cache) exit(1);
+
+    prebuilt_response_t resp = file_response();
+    char path[64];
+    for (int i = 0; i < NUM_FILES; i++) {
+        snprintf(path, sizeof(path), "./www/f%d.html", i);
+        cache_put(cache, path, &resp);
+    }
+    return cache;
+}
+
+// percentagem de hits nos pedidos de ficheiros populares, com metade do
+// tráfego a varrer ficheiros que nunca voltam a ser pedidos
+static double hit_ratio(int policy, long requests) {
+    cache_t *cache = cache_create(HIT_CACHE_BYTES, 0, policy, 0);
+    if (!cache) exit(1);
+
+    prebuilt_response_t resp = file_response();
+    prebuilt_response_t cached;
+    unsigned seed = 42;
+    long hot = 0, hits = 0, scanned = 0;
+    char path[64];
+
+    for (long i = 0; i < requests; i++) {
+        int is_hot = rand_r(&seed) % 100 >= SCAN_PERCENT;
+        if (is_hot) {
+            double u = (double)rand_r(&seed) / RAND_MAX;
+            snprintf(path, sizeof(path), "./www/hot/%d.html", (int)(HOT_FILES * u * u * u));
+            hot++;
+        } else {
+            snprintf(path, sizeof(path), "./www/scan/%ld.html", scanned++);
+        }
+
+        // como o servidor: miss → lê o ficheiro e tenta guardá-lo
+        cache_entry_t *e = cache_get(cache, path, &cached);
+        if (e) {
+            hits += is_hot;
+            cache_release(cache, e);
+        } else {
+            cache_put(cache, path, &resp);
+        }
+    }
+
+    cache_destroy(cache);
+    return 100.0 * hits / hot;
+}
+
+// tamanho fixo por ficheiro: maioria pequenos, alguns médios e poucos grandes
+static size_t churn_size(int file) {
+    unsigned seed = (unsigned)file * 2654435761u + 7;
+    int r = rand_r(&seed) % 100;
+    if (r < 80) return 512 + rand_r(&seed) % (8 * 1024);
+    if (r < 98) return 8 * 1024 + rand_r(&seed) % (56 * 1024);
+    return 64 * 1024 + rand_r(&seed) % (192 * 1024);
+}
+
+// substituições contínuas com tamanhos misturados: quanto do orçamento fica
+// ocupado por entradas e quantas cabem, e a taxa de hits que isso dá
+static void churn(long requests) {
+    cache_t *cache = cache_create(CHURN_CACHE_BYTES, 0, CACHE_POLICY_LRU, 0);
+    if (!cache) exit(1);
+
+    static char body[CACHE_MAX_FILE_SIZE];
+    char headers[RESPONSE_HEADERS_SIZE];
+    prebuilt_response_t cached;
+    unsigned seed = 7;
+    long hits = 0, samples = 0;
+    double used_sum = 0, entries_sum = 0;
+    char path[64];
+
+    double start = now_seconds();
+    for (long i = 0; i < requests; i++) {
+        double u = (double)rand_r(&seed) / RAND_MAX;
+        int file = (int)(CHURN_FILES * u * u);
+        snprintf(path, sizeof(path), "./www/churn/%d.bin", file);
+
+        cache_entry_t *e = cache_get(cache, path, &cached);
+        if (e) {
+            hits++;
+            cache_release(cache, e);
+        } else {
+            size_t size = churn_size(file), date_off, etag_off = 0;
+            int headers_len = build_prebuilt_headers(headers, sizeof(headers), "HTTP/1.1 200 OK",
+                                                     "application/octet-stream", (long)size, NULL,
+                                                     &date_off, &etag_off);
+            prebuilt_response_t resp = { headers, (size_t)headers_len, date_off, 0, 0, body, size };
+            cache_put(cache, path, &resp);
+        }
+
+        // amostras depois de a cache encher
+        if (i >= requests / 4 && i % 1000 == 0) {
+            size_t used = 0, entries = 0;
+            for (unsigned s = 0; s < cache->num_shards; s++) {
+                used += cache->shards[s].used_bytes;
+                entries += cache->shards[s].num_entries;
+            }
+            used_sum += (double)used / cache->max_bytes;
+            entries_sum += (double)entries;
+            samples++;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("\n%ld pedidos, %d ficheiros de 512 B a 256 KB, cache de %d MB\n",
+           requests, CHURN_FILES, CHURN_CACHE_BYTES / (1024 * 1024));
+    printf("%12s %12s %12s %14s\n", "ocupação", "entradas", "hits", "pedidos/s");
+    printf("%11.1f%% %12.0f %11.1f%% %14.0f\n", 100.0 * used_sum / samples,
+           entries_sum / samples, 100.0 * hits / requests, requests / elapsed);
+    cache_destroy(cache);
+}
+
+// W-TinyLFU: um candidato grande que ganha às vítimas frias da cauda mas perde
+// para as populares é rejeitado sem despejar nenhuma
+static void admission_check(void) {
+    cache_t *cache = cache_create(1024 * 1024, 1, CACHE_POLICY_TINYLFU, 0);
+    if (!cache) exit(1);
+    cache_shard_t *sh = &cache->shards[0];
+    size_t main_max = sh->max_bytes - sh->window_max;
+
+    prebuilt_response_t resp = file_response();
+    prebuilt_response_t cached;
+    char path[64];
+    int hot = 0;
+
+    // populares (pedidos várias vezes antes de entrar) até faltarem ~16 KB no principal
+    while (sh->lists[CACHE_SEG_PROBATION].bytes + 16 * 1024 < main_max) {
+        snprintf(path, sizeof(path), "./www/hot/%d.html", hot++);
+        for (int r = 0; r < 8; r++) cache_get(cache, path, &cached);
+        cache_put(cache, path, &resp);
+    }
+    // frias (um só pedido) a encher o resto; ficam à cauda da probatória
+    for (int i = 0; i < 64; i++) {
+        snprintf(path, sizeof(path), "./www/cold/%d.html", i);
+        cache_get(cache, path, &cached);
+        cache_put(cache, path, &resp);
+    }
+    for (int i = 0; i < hot; i++) {
+        snprintf(path, sizeof(path), "./www/hot/%d.html", i);
+        cache_entry_t *e = cache_get(cache, path, &cached);
+        if (e) cache_release(cache, e);
+    }
+
+    static char body[64 * 1024];
+    char headers[RESPONSE_HEADERS_SIZE];
+    size_t date_off, etag_off = 0;
+    int headers_len = build_prebuilt_headers(headers, sizeof(headers), "HTTP/1.1 200 OK",
+                                             "application/octet-stream", (long)sizeof(body), NULL,
+                                             &date_off, &etag_off);
+    prebuilt_response_t big = { headers, (size_t)headers_len, date_off, 0, 0, body, sizeof(body) };
+
+    size_t entries = sh->num_entries;
+    for (int r = 0; r < 4; r++) cache_get(cache, "./www/big.bin", &cached);
+    cache_put(cache, "./www/big.bin", &big);
+    cache_entry_t *e = cache_get(cache, "./www/big.bin", &cached);
+
+    printf("\nadmissão rejeitada: %zu entradas antes, %zu depois\n", entries, sh->num_entries);
+    if (e || sh->num_entries != entries) {
+        fprintf(stderr, "candidato rejeitado despejou entradas do segmento principal\n");
+        exit(1);
+    }
+    cache_destroy(cache);
+}
+
+// devolve leituras por segundo
+static double run(cache_t *cache, int num_threads, long total_ops) {
+    atomic_long hits;
+    atomic_init(&hits, 0);
+
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    reader_args_t *args = malloc(num_threads * sizeof(reader_args_t));
+
+    double start = now_seconds();
+    for (int i = 0; i < num_threads; i++) {
+        args[i].cache = cache;
+        args[i].seed = (unsigned)i * 2654435761u + 1;
+        args[i].ops = total_ops / num_threads;
+        args[i].hits = &hits;
+        pthread_create(&threads[i], NULL, reader, &args[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    long expected = (total_ops / num_threads) * num_threads;
+    if (atomic_load(&hits) != expected) {
+        fprintf(stderr, "hits %ld != %ld\n", atomic_load(&hits), expected);
+        exit(1);
+    }
+
+    free(args);
+    free(threads);
+    return expected / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    long ops = 4000000;
+    if (argc > 1) ops = atol(argv[1]);
+    if (ops <= 0) {
+        fprintf(stderr, "Uso: %s [leituras]\n", argv[0]);
+        return 1;
+    }
+
+    static const int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+    cache_t *single = fill_cache(1);
+    cache_t *sharded = fill_cache(0);
+    unsigned num_shards = sharded->num_shards;
+
+    printf("%ld leituras, %d ficheiros de %d bytes, %u shards\n\n",
+           ops, NUM_FILES, FILE_SIZE, num_shards);
+    printf("%8s %18s %18s %8s\n", "threads", "1 shard (leit/s)", "shards (leit/s)", "ganho");
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        int n = thread_counts[i];
+        double single_rate = run(single, n, ops);
+        double sharded_rate = run(sharded, n, ops);
+        printf("%8d %18.0f %18.0f %7.2fx\n", n, single_rate, sharded_rate, sharded_rate / single_rate);
+    }
+
+    // os dois segmentos usam o mesmo nome: o unlink do segundo falha sem efeito
+    cache_destroy(single);
+    cache_destroy(sharded);
+
+    long requests = ops / 4;
+    printf("\n%ld pedidos, %d populares, %d%% varrimento, cache de %d MB\n",
+           requests, HOT_FILES, SCAN_PERCENT, HIT_CACHE_BYTES / (1024 * 1024));
+    printf("%8s %18s %18s\n", "", "LRU (hits)", "W-TinyLFU (hits)");
+    printf("%8s %17.1f%% %17.1f%%\n", "", hit_ratio(CACHE_POLICY_LRU, requests),
+           hit_ratio(CACHE_POLICY_TINYLFU, requests));
+
+    admission_check();
+    churn(requests);
+    return 0;
+}
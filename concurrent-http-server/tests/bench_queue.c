@@ -0,0 +1,209 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "scheduler.h"
+
+// microbenchmark: um produtor (como o event loop) entrega itens a N threads
+// compara a fila única com mutex/condvar (local_queue_t antiga) com o escalonador
+
+#define QUEUE_CAPACITY 100
+#define WORK_SPINS     200   // trabalho simulado por item
+
+// fila única com mutex e condition variables (implementação anterior)
+typedef struct {
+    void **queue;
+    int capacity;
+    int size;
+    int front;
+    int rear;
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} mutex_queue_t;
+
+static void mutex_queue_init(mutex_queue_t *q, int capacity) {
+    q->queue = malloc(capacity * sizeof(void*));
+    q->capacity = capacity;
+    q->size = 0;
+    q->front = 0;
+    q->rear = 0;
+    q->stopping = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void mutex_queue_destroy(mutex_queue_t *q) {
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->queue);
+}
+
+static void mutex_queue_push(mutex_queue_t *q, void *item) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->size >= q->capacity && !q->stopping) {
+        pthread_cond_wait(&q->not_full, &q->mutex);
+    }
+    if (!q->stopping) {
+        q->queue[q->rear] = item;
+        q->rear = (q->rear + 1) % q->capacity;
+        q->size++;
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static void* mutex_queue_pop(mutex_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->size == 0 && !q->stopping) {
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+    }
+    void *item = NULL;
+    if (q->size > 0) {
+        item = q->queue[q->front];
+        q->front = (q->front + 1) % q->capacity;
+        q->size--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return item;
+}
+
+static void mutex_queue_stop(mutex_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->stopping = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+typedef struct {
+    mutex_queue_t *mq;
+    scheduler_t   *sched;
+    int            id;
+    atomic_long   *processed;
+} consumer_args_t;
+
+static void do_work(void *item) {
+    volatile uintptr_t x = (uintptr_t)item;
+    for (int i = 0; i < WORK_SPINS; i++) {
+        x = x * 31 + i;
+    }
+}
+
+static void* mutex_consumer(void *arg) {
+    consumer_args_t *c = arg;
+    void *item;
+    while ((item = mutex_queue_pop(c->mq)) != NULL) {
+        do_work(item);
+        atomic_fetch_add_explicit(c->processed, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void* sched_consumer(void *arg) {
+    consumer_args_t *c = arg;
+    void *item;
+    while ((item = scheduler_next(c->sched, c->id)) != NULL) {
+        do_work(item);
+        atomic_fetch_add_explicit(c->processed, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// devolve itens por segundo
+static double run(int use_sched, int num_threads, long items) {
+    mutex_queue_t mq;
+    scheduler_t sched;
+    atomic_long processed;
+    atomic_init(&processed, 0);
+
+    if (use_sched) {
+        int per_thread = (QUEUE_CAPACITY + num_threads - 1) / num_threads;
+        if (scheduler_init(&sched, num_threads, per_thread) != 0) {
+            perror("scheduler_init");
+            exit(1);
+        }
+    } else {
+        mutex_queue_init(&mq, QUEUE_CAPACITY);
+    }
+
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    consumer_args_t *args = malloc(num_threads * sizeof(consumer_args_t));
+    for (int i = 0; i < num_threads; i++) {
+        args[i].mq = &mq;
+        args[i].sched = &sched;
+        args[i].id = i;
+        args[i].processed = &processed;
+        pthread_create(&threads[i], NULL, use_sched ? sched_consumer : mutex_consumer, &args[i]);
+    }
+
+    double start = now_seconds();
+    for (long i = 1; i <= items; i++) {
+        if (use_sched) {
+            scheduler_submit(&sched, (void*)(uintptr_t)i);
+        } else {
+            mutex_queue_push(&mq, (void*)(uintptr_t)i);
+        }
+    }
+    while (atomic_load(&processed) < items) {
+        sched_yield();
+    }
+    double elapsed = now_seconds() - start;
+
+    if (use_sched) {
+        scheduler_stop(&sched);
+    } else {
+        mutex_queue_stop(&mq);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (use_sched) {
+        scheduler_destroy(&sched);
+    } else {
+        mutex_queue_destroy(&mq);
+    }
+    free(args);
+    free(threads);
+
+    return items / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    long items = 1000000;
+    if (argc > 1) items = atol(argv[1]);
+    if (items <= 0) {
+        fprintf(stderr, "Uso: %s [itens]\n", argv[0]);
+        return 1;
+    }
+
+    static const int thread_counts[] = {1, 4, 16, 64};
+
+    printf("%ld itens, 1 produtor, %d iterações de trabalho por item\n\n", items, WORK_SPINS);
+    printf("%8s %18s %18s %8s\n", "threads", "mutex (itens/s)", "stealing (itens/s)", "ganho");
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        int n = thread_counts[i];
+        double mutex_rate = run(0, n, items);
+        double sched_rate = run(1, n, items);
+        printf("%8d %18.0f %18.0f %7.2fx\n", n, mutex_rate, sched_rate, sched_rate / mutex_rate);
+    }
+
+    return 0;
+}
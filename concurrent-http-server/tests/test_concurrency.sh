@@ -220,10 +220,252 @@ test_statistics_accuracy() {
     fi
 }
 
+test_idle_keepalive() {
+    echo ""
+    echo "--- Teste 16b: Conexões keep-alive idle não ocupam threads ---"
+    
+    local idle_conns=100
+    local fds=()
+    
+    # mais conexões idle do que NUM_WORKERS * THREADS_PER_WORKER
+    for i in $(seq 1 $idle_conns); do
+        local fd
+        if exec {fd}<>/dev/tcp/localhost/8080 2>/dev/null; then
+            fds+=("$fd")
+        fi
+    done
+    
+    echo "Conexões idle abertas: ${#fds[@]}"
+    
+    local code
+    code=$(curl -s -o /dev/null -m 2 -w "%{http_code}" "${BASE_URL}/index.html" 2>/dev/null || echo "000")
+    
+    for fd in "${fds[@]}"; do
+        exec {fd}>&-
+    done
+    
+    if [ "$code" = "200" ]; then
+        echo -e "${GREEN}[OK]${NC} Pedido servido com ${#fds[@]} conexões idle abertas"
+    else
+        echo -e "${RED}[FAIL]${NC} Pedido bloqueado por conexões idle (código ${code})"
+        FAIL=1
+    fi
+}
+
+test_slow_readers() {
+    echo ""
+    echo "--- Teste 16c: Clientes lentos não ocupam threads ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local big_file="${www_dir}/slow_reader_test.bin"
+    local size=$((4 * 1024 * 1024))
+    local slow_conns=60
+    local fds=()
+    
+    head -c "$size" /dev/zero > "$big_file"
+    
+    # pedidos de ficheiro grande cujas respostas ninguém lê (enche o buffer do socket)
+    for i in $(seq 1 $slow_conns); do
+        local fd
+        if exec {fd}<>/dev/tcp/localhost/8080 2>/dev/null; then
+            printf 'GET /slow_reader_test.bin HTTP/1.0\r\nHost: localhost\r\n\r\n' >&"$fd"
+            fds+=("$fd")
+        fi
+    done
+    sleep 1
+    
+    echo "Clientes lentos: ${#fds[@]}"
+    
+    local code
+    code=$(curl -s -o /dev/null -m 2 -w "%{http_code}" "${BASE_URL}/index.html" 2>/dev/null || echo "000")
+    
+    # cada cliente lento acaba por receber a resposta completa
+    local incomplete=0
+    for fd in "${fds[@]}"; do
+        local got
+        got=$(timeout 10 cat <&"$fd" | wc -c || true)
+        if [ "$got" -lt "$size" ]; then
+            incomplete=$((incomplete + 1))
+        fi
+        exec {fd}>&-
+    done
+    
+    rm -f "$big_file"
+    
+    if [ "$code" = "200" ] && [ "$incomplete" -eq 0 ]; then
+        echo -e "${GREEN}[OK]${NC} Pedido servido com ${#fds[@]} clientes lentos; respostas completas"
+    else
+        echo -e "${RED}[FAIL]${NC} Pedido: ${code}, respostas incompletas: ${incomplete}"
+        FAIL=1
+    fi
+}
+
+test_keepalive_timeout() {
+    echo ""
+    echo "--- Teste 16d: Conexão keep-alive idle fechada pelo servidor ---"
+    
+    local conf
+    conf="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/server.conf"
+    local idle_timeout
+    idle_timeout=$(grep -E '^KEEPALIVE_TIMEOUT_SECONDS=' "$conf" 2>/dev/null | cut -d= -f2 || true)
+    idle_timeout=${idle_timeout:-5}
+    
+    local fd
+    if ! exec {fd}<>/dev/tcp/localhost/8080 2>/dev/null; then
+        echo -e "${RED}[FAIL]${NC} Não foi possível abrir conexão"
+        FAIL=1
+        return
+    fi
+    printf 'GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n' >&"$fd"
+    sleep $((idle_timeout + 2))
+    
+    # o servidor já fechou: cat termina com EOF em vez de esperar pelo timeout
+    local rc=0
+    timeout 3 cat <&"$fd" > /dev/null || rc=$?
+    exec {fd}>&-
+    
+    if [ "$rc" -eq 0 ]; then
+        echo -e "${GREEN}[OK]${NC} Conexão idle fechada após ${idle_timeout}s"
+    else
+        echo -e "${RED}[FAIL]${NC} Conexão idle continua aberta após $((idle_timeout + 2))s"
+        FAIL=1
+    fi
+}
+
+test_coalesced_misses() {
+    echo ""
+    echo "--- Teste 16e: Misses simultâneos a um ficheiro invalidado: uma leitura ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local file="${www_dir}/herd_test.bin"
+    local clients=50
+    
+    # abaixo de CACHE_MAX_FILE_SIZE: entra inteiro na cache
+    head -c $((900 * 1024)) /dev/urandom > "$file"
+    curl -s -o /dev/null "${BASE_URL}/herd_test.bin" 2>/dev/null || true
+    head -c $((900 * 1024)) /dev/urandom > "$file"
+    sleep 1.5
+    
+    local reads_before reads_after
+    reads_before=$(curl -s "${STATS_URL}" 2>/dev/null | grep -oP '(?<="cache_disk_reads":)\s*\d+' | tr -d ' ' || true)
+    
+    local tmp_codes
+    tmp_codes=$(mktemp)
+    for i in $(seq 1 $clients); do
+        curl -s -o /dev/null -w "%{http_code}\n" "${BASE_URL}/herd_test.bin" >> "$tmp_codes" 2>/dev/null &
+    done
+    wait
+    
+    reads_after=$(curl -s "${STATS_URL}" 2>/dev/null | grep -oP '(?<="cache_disk_reads":)\s*\d+' | tr -d ' ' || true)
+    local ok
+    ok=$(grep -c "^200$" "$tmp_codes" || true)
+    rm -f "$tmp_codes" "$file"
+    
+    if [ -z "$reads_before" ] || [ -z "$reads_after" ]; then
+        echo -e "${YELLOW}[SKIP]${NC} /stats sem cache_disk_reads (cache desativada?)"
+        return
+    fi
+    
+    local reads=$((reads_after - reads_before))
+    if [ "$ok" -eq "$clients" ] && [ "$reads" -eq 1 ]; then
+        echo -e "${GREEN}[OK]${NC} ${clients} pedidos simultâneos, ${reads} leitura do disco"
+    else
+        echo -e "${RED}[FAIL]${NC} ${ok}/${clients} respostas 200, ${reads} leituras do disco (esperado 1)"
+        FAIL=1
+    fi
+}
+
+# servidor à parte (porta 8090, 1 worker com 1 thread) com o controlo de
+# admissão dado; imprime o PID
+start_overload_server() {
+    local dir="$1" depth="$2" target="$3" interval="$4"
+    local root
+    root="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+    
+    ln -s "${root}/www" "${dir}/www"
+    sed -e 's/^PORT=.*/PORT=8090/' \
+        -e 's/^NUM_WORKERS=.*/NUM_WORKERS=1/' \
+        -e 's/^THREADS_PER_WORKER=.*/THREADS_PER_WORKER=1/' \
+        -e 's/^CACHE_WARMUP=.*/CACHE_WARMUP=off/' \
+        -e "s/^OVERLOAD_QUEUE_DEPTH=.*/OVERLOAD_QUEUE_DEPTH=${depth}/" \
+        -e "s/^OVERLOAD_TARGET_DELAY_MS=.*/OVERLOAD_TARGET_DELAY_MS=${target}/" \
+        -e "s/^OVERLOAD_INTERVAL_MS=.*/OVERLOAD_INTERVAL_MS=${interval}/" \
+        -e 's/^RETRY_AFTER_SECONDS=.*/RETRY_AFTER_SECONDS=7/' \
+        "${root}/server.conf" > "${dir}/server.conf"
+    
+    (cd "$dir" && exec setsid "${root}/server" > /dev/null 2>&1) &
+    echo $!
+}
+
+test_overload() {
+    echo ""
+    echo "--- Teste 16f: Sobrecarga: 503 com Retry-After (fila e atraso) ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local files=40
+    
+    # ficheiros a mais para a cache: cada pedido lê ~1 MB do disco e a única
+    # thread fica ocupada o suficiente para a fila crescer
+    mkdir -p "${www_dir}/overload_test"
+    for i in $(seq 1 $files); do
+        head -c $((900 * 1024)) /dev/zero > "${www_dir}/overload_test/${i}.bin"
+    done
+    local urls=()
+    for i in $(seq 1 1000); do
+        urls+=(-o /dev/null "http://localhost:8090/overload_test/$((i % files + 1)).bin")
+    done
+    
+    # OVERLOAD_QUEUE_DEPTH=1 sem alvo de atraso, depois só o alvo de atraso (CoDel)
+    local mode depth target label
+    for mode in depth codel; do
+        if [ "$mode" = "depth" ]; then
+            depth=1; target=0; label="OVERLOAD_QUEUE_DEPTH=1"
+        else
+            depth=0; target=1; label="OVERLOAD_TARGET_DELAY_MS=1"
+        fi
+        
+        local dir pid
+        dir=$(mktemp -d)
+        pid=$(start_overload_server "$dir" "$depth" "$target" 10)
+        sleep 2
+        
+        local results
+        results=$(curl -s --parallel --parallel-immediate --parallel-max 1000 \
+                       -w "%{http_code} %header{retry-after}\n" "${urls[@]}" 2>/dev/null || true)
+        
+        kill -TERM "$pid" 2>/dev/null || true
+        sleep 1
+        
+        local ok shed retry logged
+        ok=$(echo "$results" | grep -c "^200 " || true)
+        shed=$(echo "$results" | grep -c "^503 " || true)
+        retry=$(echo "$results" | grep -c "^503 7$" || true)
+        logged=$(grep -c '"GET /overload_test/[0-9]*.bin HTTP/1.1" 503 ' "${dir}/server.log" 2>/dev/null || true)
+        rm -rf "$dir"
+        
+        if [ "$shed" -gt 0 ] && [ "$retry" -eq "$shed" ] && [ "$ok" -gt 0 ] && [ "$logged" -gt 0 ]; then
+            echo -e "${GREEN}[OK]${NC} ${label}: ${shed} respostas 503 com Retry-After: 7 (${logged} no log), ${ok} servidas"
+        else
+            echo -e "${RED}[FAIL]${NC} ${label}: ${ok} 200, ${shed} 503 (${retry} com Retry-After: 7), ${logged} 503 no log"
+            FAIL=1
+        fi
+    done
+    
+    rm -rf "${www_dir}/overload_test"
+}
+
 test_apache_bench
 test_no_dropped_connections
 test_parallel_clients
 test_statistics_accuracy
+test_idle_keepalive
+test_slow_readers
+test_keepalive_timeout
+test_coalesced_misses
+test_overload
 
 echo ""
 echo "========================================"
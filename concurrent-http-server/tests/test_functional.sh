@@ -112,10 +112,239 @@ test_content_type_headers() {
     test_content_type "/img/logo.png" "image" "PNG Content-Type"
 }
 
+test_range_requests() {
+    echo ""
+    echo "--- Teste 12b: Range requests (206 Partial Content) ---"
+    
+    local code size
+    code=$(curl -s -o /dev/null -r 0-9 -w "%{http_code}" "${BASE_URL}/index.html" 2>/dev/null || echo "000")
+    size=$(curl -s -r 0-9 "${BASE_URL}/index.html" 2>/dev/null | wc -c)
+    
+    if [ "$code" = "206" ] && [ "$size" -eq 10 ]; then
+        echo -e "${GREEN}[OK]${NC} Range 0-9 -> ${code}, ${size} bytes"
+    else
+        echo -e "${RED}[FAIL]${NC} Range 0-9 -> ${code}, ${size} bytes (esperado 206, 10 bytes)"
+        FAIL=1
+    fi
+    
+    # com a resposta em cache e sem ela (ficheiro novo): contados como 416
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    echo "range" > "${www_dir}/range_416_test.txt"
+    local before after
+    before=$(curl -s "${BASE_URL}/stats" 2>/dev/null | grep -oP '(?<="416":)\s*\d+' | tr -d ' ' || true)
+    test_status_range "/index.html" "99999999-" "416" "Range fora do ficheiro"
+    test_status_range "/range_416_test.txt" "99999999-" "416" "Range fora do ficheiro (sem cache)"
+    after=$(curl -s "${BASE_URL}/stats" 2>/dev/null | grep -oP '(?<="416":)\s*\d+' | tr -d ' ' || true)
+    rm -f "${www_dir}/range_416_test.txt"
+    
+    if [ -n "$before" ] && [ -n "$after" ] && [ $((after - before)) -eq 2 ]; then
+        echo -e "${GREEN}[OK]${NC} /stats conta os dois 416"
+    else
+        echo -e "${RED}[FAIL]${NC} /stats 416: ${before:-?} -> ${after:-?} (esperado +2)"
+        FAIL=1
+    fi
+}
+
+test_pipelining() {
+    echo ""
+    echo "--- Teste 12c: HTTP/1.1 pipelining ---"
+    
+    local fd
+    if ! exec {fd}<>/dev/tcp/localhost/8080 2>/dev/null; then
+        echo -e "${RED}[FAIL]${NC} Não foi possível abrir conexão"
+        FAIL=1
+        return
+    fi
+    
+    # três pedidos num só envio; o último pede para fechar
+    printf 'GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\nGET /style.css HTTP/1.1\r\nHost: localhost\r\n\r\nGET /app.js HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n' >&"$fd"
+    
+    local responses
+    responses=$(timeout 5 cat <&"$fd" | tr -d '\r' || true)
+    exec {fd}>&-
+    
+    local count order
+    count=$(echo "$responses" | grep -c "^HTTP/1.1 200" || true)
+    order=$(echo "$responses" | grep "^Content-Type:" | tr '\n' ' ')
+    
+    if [ "$count" -eq 3 ] && [[ "$order" == *"text/html"*"text/css"*"application/javascript"* ]]; then
+        echo -e "${GREEN}[OK]${NC} 3 pedidos em pipeline -> 3 respostas por ordem"
+    else
+        echo -e "${RED}[FAIL]${NC} Pipelining: ${count} respostas (${order})"
+        FAIL=1
+    fi
+}
+
+test_cache_invalidation() {
+    echo ""
+    echo "--- Teste 12d: Ficheiro alterado no disco sai da cache ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local file="${www_dir}/cache_invalidation_test.txt"
+    
+    echo "versao-1" > "$file"
+    # dois pedidos: o primeiro põe o ficheiro na cache, o segundo vem da cache
+    curl -s "${BASE_URL}/cache_invalidation_test.txt" > /dev/null 2>&1 || true
+    curl -s "${BASE_URL}/cache_invalidation_test.txt" > /dev/null 2>&1 || true
+    
+    echo "versao-2-alterada" > "$file"
+    sleep 0.5
+    
+    local body
+    body=$(curl -s "${BASE_URL}/cache_invalidation_test.txt" 2>/dev/null || true)
+    rm -f "$file"
+    
+    if [ "$body" = "versao-2-alterada" ]; then
+        echo -e "${GREEN}[OK]${NC} Conteúdo novo servido depois da alteração"
+    else
+        echo -e "${RED}[FAIL]${NC} Conteúdo desatualizado: '${body}' (esperado 'versao-2-alterada')"
+        FAIL=1
+    fi
+}
+
+test_negative_cache() {
+    echo ""
+    echo "--- Teste 12e: Ficheiro criado depois de um 404 ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local file="${www_dir}/negative_cache_test.txt"
+    
+    rm -f "$file"
+    # dois 404: o segundo vem da cache negativa
+    curl -s "${BASE_URL}/negative_cache_test.txt" > /dev/null 2>&1 || true
+    curl -s "${BASE_URL}/negative_cache_test.txt" > /dev/null 2>&1 || true
+    
+    echo "criado" > "$file"
+    sleep 0.5
+    
+    local code
+    code=$(curl -s -o /dev/null -w "%{http_code}" "${BASE_URL}/negative_cache_test.txt" 2>/dev/null || true)
+    rm -f "$file"
+    
+    if [ "$code" = "200" ]; then
+        echo -e "${GREEN}[OK]${NC} Ficheiro novo servido apesar do 404 em cache"
+    else
+        echo -e "${RED}[FAIL]${NC} Ficheiro criado -> ${code} (esperado 200)"
+        FAIL=1
+    fi
+}
+
+test_large_file_chunks() {
+    echo ""
+    echo "--- Teste 12f: Ficheiro grande servido aos pedaços (completo e Range) ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local file="${www_dir}/large_file_test.bin"
+    
+    # 3 MB: acima de CACHE_MAX_FILE_SIZE, vários pedaços
+    head -c 3000000 /dev/urandom > "$file"
+    local expected_full expected_range
+    expected_full=$(md5sum < "$file")
+    # intervalo que atravessa a fronteira entre o primeiro e o segundo pedaço
+    expected_range=$(head -c 263044 "$file" | tail -c 1000 | md5sum)
+    
+    # duas vezes: a primeira lê do disco, a segunda vem dos pedaços em cache
+    local i full range ok=1
+    for i in 1 2; do
+        full=$(curl -s "${BASE_URL}/large_file_test.bin" 2>/dev/null | md5sum)
+        range=$(curl -s -r 262044-263043 "${BASE_URL}/large_file_test.bin" 2>/dev/null | md5sum)
+        [ "$full" = "$expected_full" ] && [ "$range" = "$expected_range" ] || ok=0
+    done
+    rm -f "$file"
+    
+    if [ "$ok" -eq 1 ]; then
+        echo -e "${GREEN}[OK]${NC} Ficheiro de 3 MB e Range entre pedaços corretos (miss e hit)"
+    else
+        echo -e "${RED}[FAIL]${NC} Conteúdo do ficheiro grande diferente do disco"
+        FAIL=1
+    fi
+}
+
+test_conditional_get() {
+    echo ""
+    echo "--- Teste 12g: ETag e If-None-Match (304 Not Modified) ---"
+    
+    local www_dir
+    www_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/www"
+    local file="${www_dir}/etag_test.txt"
+    
+    echo "versao-1" > "$file"
+    local etag
+    etag=$(curl -s -D - -o /dev/null "${BASE_URL}/etag_test.txt" 2>/dev/null | tr -d '\r' | awk -F': ' 'tolower($1) == "etag" {print $2}')
+    
+    # o segundo pedido já vem da cache: o ETag guardado tem de ser o mesmo
+    # e o 304 é contado à parte dos 200
+    local cached not_modified before after
+    before=$(curl -s "${BASE_URL}/stats" 2>/dev/null | grep -oP '(?<="304":)\s*\d+' | tr -d ' ' || true)
+    cached=$(curl -s -o /dev/null -w "%{http_code}:%{size_download}" -H "If-None-Match: ${etag}" "${BASE_URL}/etag_test.txt" 2>/dev/null || true)
+    after=$(curl -s "${BASE_URL}/stats" 2>/dev/null | grep -oP '(?<="304":)\s*\d+' | tr -d ' ' || true)
+    
+    sleep 0.01
+    echo "versao-2" > "$file"
+    sleep 0.5
+    not_modified=$(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: ${etag}" "${BASE_URL}/etag_test.txt" 2>/dev/null || true)
+    rm -f "$file"
+    
+    if [ -n "$etag" ] && [ "$cached" = "304:0" ] && [ "$not_modified" = "200" ] &&
+       [ -n "$before" ] && [ -n "$after" ] && [ $((after - before)) -eq 1 ]; then
+        echo -e "${GREEN}[OK]${NC} ETag ${etag}: 304 sem corpo (contado em /stats), 200 depois de alterado"
+    else
+        echo -e "${RED}[FAIL]${NC} ETag '${etag}': ${cached} (esperado 304:0), alterado -> ${not_modified} (esperado 200), /stats 304: ${before:-?} -> ${after:-?}"
+        FAIL=1
+    fi
+}
+
+test_error_page_key() {
+    echo ""
+    echo "--- Teste 12h: GET /404.html depois de um 404 ---"
+    
+    # o 404 guarda a página de erro na cache; o pedido do próprio ficheiro
+    # continua a ser um 200 com ETag, e o 304 funciona para ele
+    curl -s -o /dev/null "${BASE_URL}/nao_existe_pagina_erro.html" 2>/dev/null || true
+    local etag not_modified
+    etag=$(curl -s -D - -o /dev/null "${BASE_URL}/404.html" 2>/dev/null | tr -d '\r' | awk -F': ' 'tolower($1) == "etag" {print $2}')
+    not_modified=$(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: ${etag}" "${BASE_URL}/404.html" 2>/dev/null || true)
+    
+    if [ -n "$etag" ] && [ "$not_modified" = "304" ]; then
+        echo -e "${GREEN}[OK]${NC} /404.html com ETag ${etag} e 304 depois de um 404"
+    else
+        echo -e "${RED}[FAIL]${NC} /404.html depois de um 404: ETag '${etag}', If-None-Match -> ${not_modified} (esperado 304)"
+        FAIL=1
+    fi
+}
+
+test_status_range() {
+    local path="$1"
+    local range="$2"
+    local expected="$3"
+    local description="$4"
+    local code
+
+    code=$(curl -s -o /dev/null -r "$range" -w "%{http_code}" "${BASE_URL}${path}" 2>/dev/null || echo "000")
+
+    if [ "$code" = "$expected" ]; then
+        echo -e "${GREEN}[OK]${NC} ${description}: ${path} bytes=${range} -> ${code}"
+    else
+        echo -e "${RED}[FAIL]${NC} ${description}: ${path} bytes=${range} -> ${code} (esperado ${expected})"
+        FAIL=1
+    fi
+}
+
 test_get_file_types
 test_http_status_codes
 test_directory_index
 test_content_type_headers
+test_range_requests
+test_pipelining
+test_cache_invalidation
+test_negative_cache
+test_large_file_chunks
+test_conditional_get
+test_error_page_key
 
 echo ""
 echo "========================================"